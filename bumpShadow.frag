@@ -46,8 +46,6 @@ in vec4 Position;
 in vec3 Normal;
 in vec3 View;
 in vec4 LightPosition;
-in vec3 Tangent;
-in vec3 BiTangent;
 in vec2 texCoord;
 
 // Perform shadow depth comparison
@@ -65,19 +63,23 @@ float ShadowCalculation(vec4 fragLightPos) {
     return curDepth - bias > closestDepth ? 1.0f : 0.0f;
 }
 
+// Tangent, bitangent and normal (vertexFrame.frag or derivFrame.frag)
+mat3 tangent_frame(vec3 N, vec3 P, vec2 uv);
+
 void main()
 {
     vec3 rgb = vec3(0.0f);
     vec3 NormNormal = normalize(Normal);
     vec3 NormView = normalize(View);
+    mat3 ToTangent = transpose(tangent_frame(NormNormal, Position.xyz, texCoord));
 
-    // Retrieve normal from normal map
-    vec4 BumpCol = texture(normalMap, texCoord);
-    // Compute perturbed per pixel normal vector from normal map color
-    vec3 BumpNorm = normalize(2.0f*BumpCol.rgb - 1.0f);
+    // Retrieve normal from two channel (BC5/RG) normal map
+    vec2 BumpXY = 2.0f*texture(normalMap, texCoord).rg - 1.0f;
+    // Reconstruct z of unit length tangent space normal
+    vec3 BumpNorm = normalize(vec3(BumpXY, sqrt(max(0.0f, 1.0f - dot(BumpXY, BumpXY)))));
 
     // Convert view vector to tangent space
-    vec3 TangView = normalize(vec3(dot(Tangent, NormView),dot(BiTangent, NormView),dot(Normal, NormView)));
+    vec3 TangView = normalize(ToTangent*NormView);
 
     for (int i = 0; i < NumLights; i++) {
 
@@ -92,7 +94,7 @@ void main()
             if (Lights[i].type == 1) {
                 vec3 LightDir = -normalize(vec3(Lights[i].direction));
                 // TODO: Compute light vector to tangent space
-                vec3 LightDirection = vec3(dot(Tangent, LightDir), dot(BiTangent, LightDir), dot(Normal, LightDir));
+                vec3 LightDirection = ToTangent*LightDir;
                 LightDirection = normalize(LightDirection);
                 vec3 HalfVector = normalize(LightDirection + TangView);
                 // Diffuse
@@ -107,7 +109,7 @@ void main()
             if (Lights[i].type == 2) {
                 vec3 LightDir = normalize(vec3(Lights[i].position - Position));
                 // TODO: Compute light vector to tangent space
-                vec3 LightDirection = vec3(dot(Tangent, LightDir), dot(BiTangent, LightDir), dot(Normal, LightDir));
+                vec3 LightDirection = ToTangent*LightDir;
                 LightDirection = normalize(LightDirection);
                 vec3 HalfVector = normalize(LightDirection + TangView);
                 // Diffuse
@@ -122,7 +124,7 @@ void main()
             if (Lights[i].type == 3) {
                 vec3 LightDir = normalize(vec3(Lights[i].position - Position));
                 // TODO: Compute light vector to tangent space
-                vec3 LightDirection = vec3(dot(Tangent, LightDir), dot(BiTangent, LightDir), dot(Normal, LightDir));
+                vec3 LightDirection = ToTangent*LightDir;
                 LightDirection = normalize(LightDirection);
                 // Compute amount inside cone
                 float spotCos = dot(LightDir, -normalize(vec3(Lights[i].direction)));
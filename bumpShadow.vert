@@ -3,8 +3,6 @@
 layout(location = 0) in vec4 vPosition;
 layout(location = 1) in vec3 vNormal;
 layout(location = 2) in vec2 vTexCoord;
-layout(location = 3) in vec3 vTangent;
-layout(location = 4) in vec3 vBiTangent;
 
 uniform mat4 proj_matrix;
 uniform mat4 camera_matrix;
@@ -19,8 +17,9 @@ out vec3 Normal;
 out vec3 View;
 out vec4 LightPosition;
 out vec2 texCoord;
-out vec3 Tangent;
-out vec3 BiTangent;
+
+// Tangent frame outputs (vertexFrame.vert or derivFrame.vert)
+void tangent_frame(vec3 Normal);
 
 void main( )
 {
@@ -43,6 +42,5 @@ void main( )
     LightPosition = light_proj_matrix*(light_cam_matrix*Position);
 
     // Compute tangent space vectors
-    Tangent = vec3(normalize(normal_matrix*normalize(vec4(vTangent, 0.0))));
-    BiTangent = cross(Normal, Tangent);
+    tangent_frame(Normal);
 }
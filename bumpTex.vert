@@ -7,18 +7,17 @@ uniform mat4 model_matrix;
 layout(location = 0) in vec4 vPosition;
 layout(location = 1) in vec3 vNormal;
 layout(location = 2) in vec2 vTexCoord;
-layout(location = 3) in vec3 vTangent;
-layout(location = 4) in vec3 vBiTangent;
 
 uniform vec3 EyePosition;
 
 out vec4 Position;
 out vec2 texCoord;
 out vec3 Normal;
-out vec3 Tangent;
-out vec3 BiTangent;
 out vec3 View;
 
+// Tangent frame outputs (vertexFrame.vert or derivFrame.vert)
+void tangent_frame(vec3 Normal);
+
 void main( )
 {
     // Compute transformed vertex position in view space
@@ -35,6 +34,5 @@ void main( )
 
     // Compute tangent space vectors
     Normal = vec3(normalize(normal_matrix*normalize(vec4(vNormal, 0.0))));
-    Tangent = vec3(normalize(normal_matrix*normalize(vec4(vTangent, 0.0))));
-    BiTangent = cross(Normal, Tangent);
+    tangent_frame(Normal);
 }
@@ -0,0 +1,232 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <algorithm>
+#include <math.h>
+#include "bvh.h"
+
+using namespace vmath;
+using namespace std;
+
+// Traversal stack depth (median splits keep tree depth near log2 of item count)
+const int MaxBvhDepth = 64;
+
+// Box entirely on inner side of every plane
+static bool box_inside(const Frustum &frustum, const vec3 &lo, const vec3 &hi) {
+    for (int p = 0; p < 6; p++) {
+        // Corner nearest against plane normal
+        const vec4 &n = frustum.planes[p];
+        GLfloat d = n[3];
+        for (int k = 0; k < 3; k++) {
+            d += n[k]*(n[k] >= 0.0f ? lo[k] : hi[k]);
+        }
+        if (d < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool boxes_overlap(const vec3 &alo, const vec3 &ahi, const vec3 &blo, const vec3 &bhi) {
+    for (int k = 0; k < 3; k++) {
+        if (alo[k] > bhi[k] || blo[k] > ahi[k]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Slab test returning entry distance (false if ray misses within [0, max_t])
+static bool ray_box(const vec3 &origin, const vec3 &inv_dir, const vec3 &lo, const vec3 &hi, GLfloat max_t, GLfloat &t) {
+    GLfloat t0 = 0.0f;
+    GLfloat t1 = max_t;
+    for (int k = 0; k < 3; k++) {
+        GLfloat a = (lo[k] - origin[k])*inv_dir[k];
+        GLfloat b = (hi[k] - origin[k])*inv_dir[k];
+        // NaN from flat boxes parallel to ray fails both comparisons and is ignored
+        t0 = max(t0, min(a, b));
+        t1 = min(t1, max(a, b));
+    }
+    t = t0;
+    return t0 <= t1;
+}
+
+void Bvh::build(const vector<vec3> &lo, const vector<vec3> &hi) {
+    GLuint count = (GLuint)lo.size();
+    nodes.clear();
+    itemLeaf.assign(count, -1);
+    if (count == 0) {
+        return;
+    }
+    nodes.reserve(2*count - 1);
+    vector<GLuint> items(count);
+    for (GLuint i = 0; i < count; i++) {
+        items[i] = i;
+    }
+    build_range(items.data(), count, -1, lo, hi);
+}
+
+GLint Bvh::build_range(GLuint *items, GLuint count, GLint parent, const vector<vec3> &lo, const vector<vec3> &hi) {
+    GLint id = (GLint)nodes.size();
+    nodes.push_back(Node());
+    Node node;
+    node.parent = parent;
+    node.right = -1;
+    node.item = -1;
+
+    // Bounds of items and of their centroids
+    node.lo = lo[items[0]];
+    node.hi = hi[items[0]];
+    vec3 clo = (lo[items[0]] + hi[items[0]])*0.5f;
+    vec3 chi = clo;
+    for (GLuint i = 1; i < count; i++) {
+        vec3 c = (lo[items[i]] + hi[items[i]])*0.5f;
+        for (int k = 0; k < 3; k++) {
+            node.lo[k] = min(node.lo[k], lo[items[i]][k]);
+            node.hi[k] = max(node.hi[k], hi[items[i]][k]);
+            clo[k] = min(clo[k], c[k]);
+            chi[k] = max(chi[k], c[k]);
+        }
+    }
+
+    if (count == 1) {
+        node.item = (GLint)items[0];
+        itemLeaf[items[0]] = id;
+        nodes[id] = node;
+        return id;
+    }
+
+    // Median split along longest centroid axis
+    int axis = 0;
+    for (int k = 1; k < 3; k++) {
+        if (chi[k] - clo[k] > chi[axis] - clo[axis]) {
+            axis = k;
+        }
+    }
+    GLuint half = count/2;
+    nth_element(items, items + half, items + count, [&](GLuint a, GLuint b) {
+        return lo[a][axis] + hi[a][axis] < lo[b][axis] + hi[b][axis];
+    });
+    nodes[id] = node;
+    build_range(items, half, id, lo, hi);
+    nodes[id].right = build_range(items + half, count - half, id, lo, hi);
+    return id;
+}
+
+void Bvh::update(GLuint item, const vec3 &lo, const vec3 &hi) {
+    GLint id = itemLeaf[item];
+    nodes[id].lo = lo;
+    nodes[id].hi = hi;
+
+    // Refit ancestors from their children
+    for (id = nodes[id].parent; id >= 0; id = nodes[id].parent) {
+        const Node &l = nodes[id + 1];
+        const Node &r = nodes[nodes[id].right];
+        for (int k = 0; k < 3; k++) {
+            nodes[id].lo[k] = min(l.lo[k], r.lo[k]);
+            nodes[id].hi[k] = max(l.hi[k], r.hi[k]);
+        }
+    }
+}
+
+void Bvh::query_frustum(const Frustum &frustum, vector<GLubyte> &visible) const {
+    if (nodes.empty()) {
+        return;
+    }
+    // Stack entries carry whether planes still need testing (subtrees fully inside skip tests)
+    GLint stack[MaxBvhDepth];
+    bool test[MaxBvhDepth];
+    int top = 0;
+    stack[top] = 0;
+    test[top++] = true;
+    while (top > 0) {
+        top--;
+        GLint id = stack[top];
+        bool planes = test[top];
+        const Node &node = nodes[id];
+        if (planes) {
+            if (!box_visible(frustum, node.lo, node.hi)) {
+                continue;
+            }
+            planes = !box_inside(frustum, node.lo, node.hi);
+        }
+        if (node.item >= 0) {
+            visible[node.item] = 1;
+            continue;
+        }
+        stack[top] = node.right;
+        test[top++] = planes;
+        stack[top] = id + 1;
+        test[top++] = planes;
+    }
+}
+
+void Bvh::query_box(const vec3 &lo, const vec3 &hi, vector<GLuint> &items) const {
+    if (nodes.empty()) {
+        return;
+    }
+    GLint stack[MaxBvhDepth];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        GLint id = stack[--top];
+        const Node &node = nodes[id];
+        if (!boxes_overlap(lo, hi, node.lo, node.hi)) {
+            continue;
+        }
+        if (node.item >= 0) {
+            items.push_back((GLuint)node.item);
+            continue;
+        }
+        stack[top++] = node.right;
+        stack[top++] = id + 1;
+    }
+}
+
+bool Bvh::ray_cast(const vec3 &origin, const vec3 &dir, GLfloat max_t, GLuint &item, GLfloat &t) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    vec3 inv_dir;
+    for (int k = 0; k < 3; k++) {
+        inv_dir[k] = 1.0f/dir[k];
+    }
+    GLfloat best = max_t;
+    GLint hit = -1;
+    GLint stack[MaxBvhDepth];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        GLint id = stack[--top];
+        const Node &node = nodes[id];
+        GLfloat entry;
+        if (!ray_box(origin, inv_dir, node.lo, node.hi, best, entry)) {
+            continue;
+        }
+        if (node.item >= 0) {
+            best = entry;
+            hit = node.item;
+            continue;
+        }
+        // Visit nearer child first so farther subtrees are pruned by best hit
+        GLint l = id + 1;
+        GLint r = node.right;
+        GLfloat tl, tr;
+        bool hl = ray_box(origin, inv_dir, nodes[l].lo, nodes[l].hi, best, tl);
+        bool hr = ray_box(origin, inv_dir, nodes[r].lo, nodes[r].hi, best, tr);
+        if (hl && hr) {
+            stack[top++] = tl < tr ? r : l;
+            stack[top++] = tl < tr ? l : r;
+        } else if (hl) {
+            stack[top++] = l;
+        } else if (hr) {
+            stack[top++] = r;
+        }
+    }
+    if (hit < 0) {
+        return false;
+    }
+    item = (GLuint)hit;
+    t = best;
+    return true;
+}
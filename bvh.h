@@ -0,0 +1,50 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "../common/vgl.h"
+#include "../common/vmath.h"
+#include "culling.h"
+
+// Bounding volume hierarchy over world space item boxes (one item per leaf).
+// build() splits at the median centroid of the longest axis; update() refits
+// the boxes on the path from a moved item to the root without changing topology,
+// so it stays cheap for small animated parts while a rebuild follows new items.
+class Bvh {
+public:
+    // Rebuild over boxes of items 0..count-1
+    void build(const std::vector<vmath::vec3> &lo, const std::vector<vmath::vec3> &hi);
+
+    // Refit after item box changed
+    void update(GLuint item, const vmath::vec3 &lo, const vmath::vec3 &hi);
+
+    // Set visible[item] for items whose boxes intersect frustum (others untouched)
+    void query_frustum(const Frustum &frustum, std::vector<GLubyte> &visible) const;
+
+    // Append items whose boxes overlap box
+    void query_box(const vmath::vec3 &lo, const vmath::vec3 &hi, std::vector<GLuint> &items) const;
+
+    // Nearest item box hit by ray within max_t (returns false if none)
+    bool ray_cast(const vmath::vec3 &origin, const vmath::vec3 &dir, GLfloat max_t, GLuint &item, GLfloat &t) const;
+
+    GLuint size() const { return (GLuint)itemLeaf.size(); }
+
+private:
+    struct Node {
+        vmath::vec3 lo;
+        vmath::vec3 hi;
+        GLint parent;
+        GLint right;    // left child follows node (interior only)
+        GLint item;     // leaf item or -1
+    };
+
+    GLint build_range(GLuint *items, GLuint count, GLint parent, const std::vector<vmath::vec3> &lo, const std::vector<vmath::vec3> &hi);
+
+    std::vector<Node> nodes;
+    std::vector<GLint> itemLeaf;
+};
+
+#endif
@@ -0,0 +1,75 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <math.h>
+#include "culling.h"
+
+using namespace vmath;
+
+void extract_frustum(const mat4 &view_proj, Frustum &frustum) {
+    // Planes are sums and differences of last matrix row with the other rows
+    for (int p = 0; p < 6; p++) {
+        int row = p/2;
+        GLfloat sign = (p & 1) ? -1.0f : 1.0f;
+        vec4 plane;
+        for (int c = 0; c < 4; c++) {
+            plane[c] = view_proj[c][3] + sign*view_proj[c][row];
+        }
+        GLfloat len = sqrt(plane[0]*plane[0] + plane[1]*plane[1] + plane[2]*plane[2]);
+        frustum.planes[p] = len > 0.0f ? plane/len : plane;
+    }
+}
+
+bool sphere_visible(const Frustum &frustum, const vec4 &sphere) {
+    for (int p = 0; p < 6; p++) {
+        const vec4 &n = frustum.planes[p];
+        if (n[0]*sphere[0] + n[1]*sphere[1] + n[2]*sphere[2] + n[3] < -sphere[3]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool box_visible(const Frustum &frustum, const vec3 &lo, const vec3 &hi) {
+    for (int p = 0; p < 6; p++) {
+        // Corner furthest along plane normal
+        const vec4 &n = frustum.planes[p];
+        GLfloat d = n[3];
+        for (int k = 0; k < 3; k++) {
+            d += n[k]*(n[k] >= 0.0f ? hi[k] : lo[k]);
+        }
+        if (d < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void transform_box(const mat4 &m, const vec3 &lo, const vec3 &hi, vec3 &out_lo, vec3 &out_hi) {
+    // Transform center and sum absolute axis contributions of half extents
+    vec3 center = (lo + hi)*0.5f;
+    vec3 extent = (hi - lo)*0.5f;
+    for (int r = 0; r < 3; r++) {
+        GLfloat c = m[3][r];
+        GLfloat e = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            c += m[k][r]*center[k];
+            e += fabs(m[k][r])*extent[k];
+        }
+        out_lo[r] = c - e;
+        out_hi[r] = c + e;
+    }
+}
+
+vec4 transform_sphere(const mat4 &m, const vec4 &sphere) {
+    // Radius grows with largest axis scale
+    vec4 out;
+    GLfloat max_scale = 0.0f;
+    for (int r = 0; r < 3; r++) {
+        out[r] = m[0][r]*sphere[0] + m[1][r]*sphere[1] + m[2][r]*sphere[2] + m[3][r];
+        GLfloat s = m[r][0]*m[r][0] + m[r][1]*m[r][1] + m[r][2]*m[r][2];
+        max_scale = s > max_scale ? s : max_scale;
+    }
+    out[3] = sphere[3]*sqrt(max_scale);
+    return out;
+}
@@ -0,0 +1,28 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef CULLING_H
+#define CULLING_H
+
+#include "../common/vgl.h"
+#include "../common/vmath.h"
+
+// View frustum as six normalized planes (xyz normal pointing inside, w distance)
+struct Frustum {
+    vmath::vec4 planes[6];
+};
+
+// Extract frustum planes from combined projection*camera matrix (world space planes)
+void extract_frustum(const vmath::mat4 &view_proj, Frustum &frustum);
+
+// Sphere (center and radius) inside or intersecting frustum
+bool sphere_visible(const Frustum &frustum, const vmath::vec4 &sphere);
+
+// Axis aligned box inside or intersecting frustum
+bool box_visible(const Frustum &frustum, const vmath::vec3 &lo, const vmath::vec3 &hi);
+
+// World space bounds of an object space box and sphere under affine model matrix
+void transform_box(const vmath::mat4 &m, const vmath::vec3 &lo, const vmath::vec3 &hi, vmath::vec3 &out_lo, vmath::vec3 &out_hi);
+vmath::vec4 transform_sphere(const vmath::mat4 &m, const vmath::vec4 &sphere);
+
+#endif
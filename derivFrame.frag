@@ -0,0 +1,20 @@
+#version 400 core
+// Tangent frame rebuilt from screen space derivatives of position and texture coordinate
+
+mat3 tangent_frame(vec3 N, vec3 P, vec2 uv)
+{
+    vec3 dp1 = dFdx(P);
+    vec3 dp2 = dFdy(P);
+    vec2 duv1 = dFdx(uv);
+    vec2 duv2 = dFdy(uv);
+
+    // Solve for surface directions of increasing u and v in plane of N
+    vec3 dp2perp = cross(dp2, N);
+    vec3 dp1perp = cross(N, dp1);
+    vec3 T = dp2perp*duv1.x + dp1perp*duv2.x;
+    vec3 B = dp2perp*duv1.y + dp1perp*duv2.y;
+
+    // Scale invariant frame (handles mirrored and stretched UVs)
+    float invmax = inversesqrt(max(max(dot(T, T), dot(B, B)), 1e-20));
+    return mat3(T*invmax, B*invmax, N);
+}
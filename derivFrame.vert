@@ -0,0 +1,6 @@
+#version 400 core
+// Derivative tangent frames are built per pixel, so no tangent stream is read
+
+void tangent_frame(vec3 Normal)
+{
+}
@@ -0,0 +1,169 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <math.h>
+#include <stdio.h>
+#include "dynamic_res.h"
+#include "frame_ring.h"
+#include "gl_state.h"
+#include "program.h"
+
+// Share of gap to scale suggested by timing closed per frame (damps timing noise)
+const GLfloat ScaleDamping = 0.5f;
+
+static const char *upscale_vertex_shader = "../upscale.vert";
+static const char *upscale_frag_shader = "../upscale.frag";
+
+static ShaderProgram upscale_program;
+static GLuint emptyVao = 0;
+
+static GLfloat budget = 0.0f;
+static GLfloat scale = MaxRenderScale;
+static GLuint queries[FramesInFlight];
+static bool queryIssued[FramesInFlight];
+static GLfloat queryScale[FramesInFlight];
+
+// Scaled target (sized for full output so scale changes never reallocate it)
+static GLuint framebuffer = 0;
+static GLuint colorTex = 0;
+static GLuint depthBuffer = 0;
+static GLint targetWidth = 0;
+static GLint targetHeight = 0;
+static GLint outputWidth = 0;
+static GLint outputHeight = 0;
+static GLint renderWidth = 0;
+static GLint renderHeight = 0;
+
+bool init_dynamic_res(GLfloat budget_ms) {
+    if (!GLEW_ARB_timer_query) {
+        printf("Dynamic resolution unavailable (no timer queries)\n");
+        return false;
+    }
+    ShaderInfo upscale_shaders[] = { {GL_VERTEX_SHADER, upscale_vertex_shader},{GL_FRAGMENT_SHADER, upscale_frag_shader},{GL_NONE, NULL} };
+    if (!load_program(upscale_program, upscale_shaders)) {
+        return false;
+    }
+    // Full screen triangle is generated from vertex index
+    glGenVertexArrays(1, &emptyVao);
+    glGenQueries(FramesInFlight, queries);
+    glGenFramebuffers(1, &framebuffer);
+    glGenTextures(1, &colorTex);
+    glGenRenderbuffers(1, &depthBuffer);
+    budget = budget_ms;
+    scale = MaxRenderScale;
+    return true;
+}
+
+// Move scale toward budget (pixel cost grows with square of scale)
+static void adjust_scale(GLfloat frame_scale, GLfloat gpu_ms) {
+    if (gpu_ms <= 0.0f) {
+        return;
+    }
+    GLfloat target = frame_scale*sqrtf(budget/gpu_ms);
+    GLfloat next = scale + ScaleDamping*(target - scale);
+    next = roundf(next/RenderScaleStep)*RenderScaleStep;
+    scale = next < MinRenderScale ? MinRenderScale : next > MaxRenderScale ? MaxRenderScale : next;
+}
+
+static void resize_target(GLint width, GLint height) {
+    state_bind_texture(GL_TEXTURE_2D, colorTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "ERROR: dynamic resolution framebuffer incomplete\n");
+    }
+    targetWidth = width;
+    targetHeight = height;
+}
+
+void begin_dynamic_frame(GLint width, GLint height, GLint &render_width, GLint &render_height) {
+    // Slot fence has passed, so its query is complete
+    GLuint slot = frame_slot();
+    if (queryIssued[slot]) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &ns);
+            adjust_scale(queryScale[slot], ns/1.0e6f);
+        }
+        queryIssued[slot] = false;
+    }
+
+    if (width != targetWidth || height != targetHeight) {
+        resize_target(width, height);
+    }
+    outputWidth = width;
+    outputHeight = height;
+    renderWidth = (GLint)(width*scale + 0.5f);
+    renderHeight = (GLint)(height*scale + 0.5f);
+    renderWidth = renderWidth > 0 ? renderWidth : 1;
+    renderHeight = renderHeight > 0 ? renderHeight : 1;
+    render_width = renderWidth;
+    render_height = renderHeight;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, renderWidth, renderHeight);
+    glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+    queryIssued[slot] = true;
+    queryScale[slot] = scale;
+}
+
+GLuint dynamic_framebuffer() {
+    return framebuffer;
+}
+
+void end_dynamic_frame(GLuint output) {
+    glBindFramebuffer(GL_FRAMEBUFFER, output);
+    glViewport(0, 0, outputWidth, outputHeight);
+    GLboolean depth = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+
+    // Sample rendered corner of target; sharpen more the further it is stretched
+    state_use_program(upscale_program.id);
+    GLfloat sharpness = UpscaleSharpness*(MaxRenderScale - scale)/(MaxRenderScale - MinRenderScale);
+    glUniform2f(program_uniform(upscale_program, UniUvScale), (GLfloat)renderWidth/targetWidth, (GLfloat)renderHeight/targetHeight);
+    glUniform2f(program_uniform(upscale_program, UniTexelSize), 1.0f/targetWidth, 1.0f/targetHeight);
+    glUniform1f(program_uniform(upscale_program, UniSharpness), sharpness);
+    set_uniform(upscale_program, UniSceneMap, 0);
+    state_active_texture(GL_TEXTURE0);
+    state_bind_texture(GL_TEXTURE_2D, colorTex);
+    state_bind_vertex_array(emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    state_bind_vertex_array(0);
+    glEndQuery(GL_TIME_ELAPSED);
+
+    if (depth) {
+        glEnable(GL_DEPTH_TEST);
+    }
+    if (blend) {
+        glEnable(GL_BLEND);
+    }
+}
+
+GLfloat render_scale() {
+    return scale;
+}
+
+void destroy_dynamic_res() {
+    glDeleteQueries(FramesInFlight, queries);
+    glDeleteFramebuffers(1, &framebuffer);
+    state_delete_textures(1, &colorTex);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    state_delete_vertex_arrays(1, &emptyVao);
+    state_delete_program(upscale_program.id);
+    for (GLuint i = 0; i < FramesInFlight; i++) {
+        queryIssued[i] = false;
+    }
+    targetWidth = targetHeight = 0;
+}
@@ -0,0 +1,41 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef DYNAMIC_RES_H
+#define DYNAMIC_RES_H
+
+#include "../common/vgl.h"
+
+// Dynamic resolution: main view renders at a scale that follows GPU frame time toward a budget
+// and is upscaled with sharpening (timer queries are read a few frames late so they never stall)
+
+// Scale range of render size per axis
+const GLfloat MinRenderScale = 0.5f;
+const GLfloat MaxRenderScale = 1.0f;
+
+// Scale moves in steps (size dependent targets are not reallocated every frame)
+const GLfloat RenderScaleStep = 0.05f;
+
+// Unsharp mask strength at minimum scale (none at full scale)
+const GLfloat UpscaleSharpness = 0.6f;
+
+// Load upscale program and start at full scale (returns false without timer queries)
+bool init_dynamic_res(GLfloat budget_ms);
+
+// Adjust scale from timing of frame that last used current slot, bind scaled target sized
+// for width x height output and start timing (call after begin_frame_slot)
+void begin_dynamic_frame(GLint width, GLint height, GLint &render_width, GLint &render_height);
+
+// Framebuffer of scaled target
+GLuint dynamic_framebuffer();
+
+// Upscale target to output framebuffer and stop timing
+void end_dynamic_frame(GLuint output);
+
+// Current scale per axis
+GLfloat render_scale();
+
+// Release target, queries and program
+void destroy_dynamic_res();
+
+#endif
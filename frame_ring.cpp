@@ -0,0 +1,34 @@
+// CS370 Final Project
+// Fall 2023
+
+#include "frame_ring.h"
+
+static GLsync fences[FramesInFlight];
+static GLuint slot = 0;
+
+void begin_frame_slot() {
+    slot = (slot + 1) % FramesInFlight;
+    if (fences[slot]) {
+        glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fences[slot]);
+        fences[slot] = 0;
+    }
+}
+
+void end_frame_slot() {
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLuint frame_slot() {
+    return slot;
+}
+
+void destroy_frame_ring() {
+    for (GLuint i = 0; i < FramesInFlight; i++) {
+        if (fences[i]) {
+            glClientWaitSync(fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+}
@@ -0,0 +1,24 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include "../common/vgl.h"
+
+// Frames the CPU may record ahead of the GPU (per frame resources keep one copy per slot)
+const GLuint FramesInFlight = 3;
+
+// Advance to next slot (waits until GPU has finished frame that last used it)
+void begin_frame_slot();
+
+// Fence commands of current frame
+void end_frame_slot();
+
+// Slot of frame being recorded
+GLuint frame_slot();
+
+// Wait for frames in flight and release fences
+void destroy_frame_ring();
+
+#endif
@@ -0,0 +1,227 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <string.h>
+#include "gl_state.h"
+
+// Binding not known to match GL (forces next bind through)
+const GLuint UnknownBinding = 0xFFFFFFFF;
+
+// Texture units and indexed buffer binding points tracked (others always reach GL)
+const GLuint MaxStateUnits = 32;
+const GLuint MaxStateIndices = 16;
+
+// Buffer targets tracked (others always reach GL)
+static const GLenum BufferTargets[] = {GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER,
+                                       GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER,
+                                       GL_DRAW_INDIRECT_BUFFER, GL_PARAMETER_BUFFER_ARB};
+const GLuint NumBufferTargets = sizeof(BufferTargets)/sizeof(BufferTargets[0]);
+const GLuint ElementTarget = 1;
+
+// Indexed binding of uniform or storage buffer range
+struct IndexedBinding {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;    // 0 for whole buffer
+};
+
+static const char *CallNames[NumStateCalls] = {"glUseProgram", "glBindVertexArray", "glBindBuffer", "glBindBufferRange",
+                                               "glActiveTexture", "glBindTexture"};
+
+static bool initialized = false;
+static GLuint program;
+static GLuint vao;
+static GLuint buffers[NumBufferTargets];
+static IndexedBinding uniformBindings[MaxStateIndices];
+static IndexedBinding storageBindings[MaxStateIndices];
+static GLuint unit;
+static GLuint textures[MaxStateUnits];
+static StateStats stats;
+
+static void init_state() {
+    program = UnknownBinding;
+    vao = UnknownBinding;
+    unit = UnknownBinding;
+    for (GLuint t = 0; t < NumBufferTargets; t++) {
+        buffers[t] = UnknownBinding;
+    }
+    for (GLuint i = 0; i < MaxStateIndices; i++) {
+        uniformBindings[i].buffer = UnknownBinding;
+        storageBindings[i].buffer = UnknownBinding;
+    }
+    for (GLuint u = 0; u < MaxStateUnits; u++) {
+        textures[u] = UnknownBinding;
+    }
+    initialized = true;
+}
+
+// Count call and return whether it must reach GL
+static bool changes(GLuint call, bool same) {
+    if (!initialized) {
+        init_state();
+        same = false;
+    }
+    if (same) {
+        stats.filtered[call]++;
+        return false;
+    }
+    stats.issued[call]++;
+    return true;
+}
+
+// Tracked slot of buffer target (-1 if untracked)
+static int buffer_slot(GLenum target) {
+    for (GLuint t = 0; t < NumBufferTargets; t++) {
+        if (BufferTargets[t] == target) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+// Indexed bindings of target (NULL if untracked)
+static IndexedBinding *indexed_binding(GLenum target, GLuint index) {
+    if (index >= MaxStateIndices) {
+        return NULL;
+    }
+    if (target == GL_UNIFORM_BUFFER) {
+        return &uniformBindings[index];
+    }
+    if (target == GL_SHADER_STORAGE_BUFFER) {
+        return &storageBindings[index];
+    }
+    return NULL;
+}
+
+void state_use_program(GLuint id) {
+    if (changes(UseProgramCall, program == id)) {
+        glUseProgram(id);
+        program = id;
+    }
+}
+
+void state_bind_vertex_array(GLuint id) {
+    if (changes(BindVertexArrayCall, vao == id)) {
+        glBindVertexArray(id);
+        vao = id;
+        buffers[ElementTarget] = UnknownBinding;
+    }
+}
+
+void state_bind_buffer(GLenum target, GLuint buffer) {
+    int slot = buffer_slot(target);
+    if (changes(BindBufferCall, slot >= 0 && buffers[slot] == buffer)) {
+        glBindBuffer(target, buffer);
+        if (slot >= 0) {
+            buffers[slot] = buffer;
+        }
+    }
+}
+
+// Indexed binds also bind generic target
+static void bind_indexed(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    IndexedBinding *binding = indexed_binding(target, index);
+    int slot = buffer_slot(target);
+    bool same = binding && binding->buffer == buffer && binding->offset == offset && binding->size == size &&
+                slot >= 0 && buffers[slot] == buffer;
+    if (changes(BindBufferRangeCall, same)) {
+        if (size > 0) {
+            glBindBufferRange(target, index, buffer, offset, size);
+        } else {
+            glBindBufferBase(target, index, buffer);
+        }
+        if (binding) {
+            binding->buffer = buffer;
+            binding->offset = offset;
+            binding->size = size;
+        }
+        if (slot >= 0) {
+            buffers[slot] = buffer;
+        }
+    }
+}
+
+void state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+    bind_indexed(target, index, buffer, 0, 0);
+}
+
+void state_bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    bind_indexed(target, index, buffer, offset, size);
+}
+
+void state_active_texture(GLenum id) {
+    if (changes(ActiveTextureCall, unit == id)) {
+        glActiveTexture(id);
+        unit = id;
+    }
+}
+
+void state_bind_texture(GLenum target, GLuint texture) {
+    GLuint u = unit - GL_TEXTURE0;
+    bool tracked = target == GL_TEXTURE_2D && unit != UnknownBinding && u < MaxStateUnits;
+    if (changes(BindTextureCall, tracked && textures[u] == texture)) {
+        glBindTexture(target, texture);
+        if (tracked) {
+            textures[u] = texture;
+        }
+    }
+}
+
+void state_delete_program(GLuint id) {
+    glDeleteProgram(id);
+    if (program == id) {
+        program = UnknownBinding;
+    }
+}
+
+void state_delete_vertex_arrays(GLsizei count, const GLuint *ids) {
+    glDeleteVertexArrays(count, ids);
+    for (GLsizei i = 0; i < count; i++) {
+        if (vao == ids[i]) {
+            vao = UnknownBinding;
+            buffers[ElementTarget] = UnknownBinding;
+        }
+    }
+}
+
+void state_delete_buffers(GLsizei count, const GLuint *ids) {
+    glDeleteBuffers(count, ids);
+    for (GLsizei i = 0; i < count; i++) {
+        for (GLuint t = 0; t < NumBufferTargets; t++) {
+            if (buffers[t] == ids[i]) {
+                buffers[t] = UnknownBinding;
+            }
+        }
+        for (GLuint b = 0; b < MaxStateIndices; b++) {
+            if (uniformBindings[b].buffer == ids[i]) {
+                uniformBindings[b].buffer = UnknownBinding;
+            }
+            if (storageBindings[b].buffer == ids[i]) {
+                storageBindings[b].buffer = UnknownBinding;
+            }
+        }
+    }
+}
+
+void state_delete_textures(GLsizei count, const GLuint *ids) {
+    glDeleteTextures(count, ids);
+    for (GLsizei i = 0; i < count; i++) {
+        for (GLuint u = 0; u < MaxStateUnits; u++) {
+            if (textures[u] == ids[i]) {
+                textures[u] = UnknownBinding;
+            }
+        }
+    }
+}
+
+const char *state_call_name(GLuint call) {
+    return CallNames[call];
+}
+
+void state_stats(StateStats &out) {
+    out = stats;
+}
+
+void reset_state_stats() {
+    memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,42 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include "../common/vgl.h"
+
+// Cache of program, vertex array, buffer and texture bindings that drops redundant binds
+// (delete through it too, so a recycled name is never taken as bound)
+
+// This and every other module issuing GL calls runs only on the render thread that owns the context
+
+enum StateCalls {UseProgramCall, BindVertexArrayCall, BindBufferCall, BindBufferRangeCall, ActiveTextureCall, BindTextureCall, NumStateCalls};
+
+// Calls passed to GL and dropped as redundant
+struct StateStats {
+    GLuint issued[NumStateCalls];
+    GLuint filtered[NumStateCalls];
+};
+
+void state_use_program(GLuint program);
+void state_bind_vertex_array(GLuint vao);
+void state_bind_buffer(GLenum target, GLuint buffer);
+void state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+void state_bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+void state_active_texture(GLenum unit);
+void state_bind_texture(GLenum target, GLuint texture);
+
+void state_delete_program(GLuint program);
+void state_delete_vertex_arrays(GLsizei count, const GLuint *vaos);
+void state_delete_buffers(GLsizei count, const GLuint *buffers);
+void state_delete_textures(GLsizei count, const GLuint *textures);
+
+// GL entry point name of call
+const char *state_call_name(GLuint call);
+
+// Counts since last reset
+void state_stats(StateStats &stats);
+void reset_state_stats();
+
+#endif
@@ -0,0 +1,107 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "../common/stb_image.h"
+#include "golden.h"
+
+// Largest squared YIQ distance (black against white)
+const GLfloat MaxYiqDelta = 35215.0f;
+
+bool read_golden(const char *filename, ImageLevel &image) {
+    int w, h, n;
+    unsigned char *data = stbi_load(filename, &w, &h, &n, 3);
+    if (!data) {
+        fprintf(stderr, "ERROR: could not load reference %s\n", filename);
+        return false;
+    }
+    image.width = w;
+    image.height = h;
+    image.pixels.assign(data, data + (size_t)w*h*3);
+    stbi_image_free(data);
+    return true;
+}
+
+bool make_golden_dir(const char *path) {
+#ifdef _WIN32
+    int result = _mkdir(path);
+#else
+    int result = mkdir(path, 0755);
+#endif
+    if (result != 0 && errno != EEXIST) {
+        fprintf(stderr, "ERROR: could not create %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool write_ppm(const char *filename, const ImageLevel &image) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "ERROR: could not write %s\n", filename);
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", image.width, image.height);
+    fwrite(image.pixels.data(), 1, image.pixels.size(), file);
+    fclose(file);
+    return true;
+}
+
+// Squared YIQ distance of two RGB pixels (Kotsarenko and Ramos weights)
+static GLfloat yiq_delta(const GLubyte *a, const GLubyte *b) {
+    GLfloat dr = (GLfloat)a[0] - b[0];
+    GLfloat dg = (GLfloat)a[1] - b[1];
+    GLfloat db = (GLfloat)a[2] - b[2];
+    GLfloat y = 0.29889531f*dr + 0.58662247f*dg + 0.11448223f*db;
+    GLfloat i = 0.59597799f*dr - 0.27417610f*dg - 0.32180189f*db;
+    GLfloat q = 0.21147017f*dr - 0.52261711f*dg + 0.31114694f*db;
+    return 0.5053f*y*y + 0.299f*i*i + 0.1957f*q*q;
+}
+
+ImageDiff compare_images(const ImageLevel &a, const ImageLevel &b, ImageLevel *highlight) {
+    ImageDiff diff = {0, 0.0f, 0.0f};
+    size_t pixels = (size_t)a.width*a.height;
+    if (highlight) {
+        highlight->width = a.width;
+        highlight->height = a.height;
+        highlight->pixels.resize(pixels*3);
+    }
+
+    // Compare squared distances against squared threshold
+    GLfloat limit = GoldenPixelThreshold*GoldenPixelThreshold*MaxYiqDelta;
+    double total = 0.0;
+    for (size_t p = 0; p < pixels; p++) {
+        GLfloat d = yiq_delta(&a.pixels[3*p], &b.pixels[3*p]);
+        bool changed = d > limit;
+        diff.changed += changed;
+        GLfloat delta = sqrtf(d/MaxYiqDelta);
+        total += delta;
+        if (delta > diff.maxDelta) {
+            diff.maxDelta = delta;
+        }
+        if (highlight) {
+            GLubyte *out = &highlight->pixels[3*p];
+            if (changed) {
+                out[0] = 255;
+                out[1] = 0;
+                out[2] = 0;
+            } else {
+                GLubyte grey = (GLubyte)(192 + (a.pixels[3*p] + a.pixels[3*p + 1] + a.pixels[3*p + 2])/12);
+                out[0] = out[1] = out[2] = grey;
+            }
+        }
+    }
+    diff.meanDelta = pixels ? (GLfloat)(total/pixels) : 0.0f;
+    return diff;
+}
+
+bool images_match(const ImageDiff &diff, const ImageLevel &image) {
+    return diff.changed <= GoldenMaxChanged*image.width*image.height;
+}
@@ -0,0 +1,41 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#include "../common/vgl.h"
+#include "image.h"
+
+// Golden image comparison for render regression tests. Pixels are compared by a perceptual
+// distance in YIQ space weighted toward brightness (as in pixelmatch), so the small shading
+// differences between drivers stay under threshold while moved or missing geometry does not.
+
+// Perceptual distance (0 to 1) above which a pixel counts as changed
+const GLfloat GoldenPixelThreshold = 0.1f;
+
+// Fraction of pixels that may change before images no longer match
+const GLfloat GoldenMaxChanged = 0.002f;
+
+struct ImageDiff {
+    GLuint changed;         // pixels over threshold
+    GLfloat meanDelta;      // mean distance over all pixels
+    GLfloat maxDelta;
+};
+
+// Read reference as RGB rows top to bottom (PPM or any format stb_image decodes)
+bool read_golden(const char *filename, ImageLevel &image);
+
+// Create reference directory if it does not exist yet
+bool make_golden_dir(const char *path);
+
+// Write RGB rows top to bottom as binary PPM
+bool write_ppm(const char *filename, const ImageLevel &image);
+
+// Compare RGB images of equal size, optionally drawing changed pixels red over a faded copy of a
+ImageDiff compare_images(const ImageLevel &a, const ImageLevel &b, ImageLevel *highlight = NULL);
+
+// Changed pixels within tolerance for image size
+bool images_match(const ImageDiff &diff, const ImageLevel &image);
+
+#endif
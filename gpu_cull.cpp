@@ -0,0 +1,336 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "culling.h"
+#include "frame_ring.h"
+#include "gl_state.h"
+#include "gpu_cull.h"
+#include "program.h"
+
+using namespace vmath;
+using namespace std;
+
+// Indirect elements draw command (GL layout)
+struct DrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Texture unit used for depth and Hi-Z sampling
+const GLuint HiZUnit = 7;
+// Compute work group sizes (match shaders)
+const GLuint CullGroupSize = 64;
+const GLuint HiZGroupSize = 8;
+
+static const char *cull_compute_shader = "../cull.comp";
+static const char *hiz_compute_shader = "../hiz.comp";
+
+static ShaderProgram cull_program;
+static ShaderProgram hiz_program;
+
+// Object and draw data hold one copy per frame slot, rewritten from CPU arrays when stale
+static GLuint objectBuffer = 0;
+static GLuint drawBuffer = 0;
+static GLuint idBuffer = 0;
+static GLuint objectCapacity = 0;
+static GLuint objectCount = 0;
+static GLintptr objectStride = 0;
+static GLintptr drawStride = 0;
+static GLint storageAlign = 1;
+static vector<CullObject> cullObjects;
+static vector<DrawObject> drawObjects;
+static GLuint objectsVersion = 0;
+static GLuint slotVersion[FramesInFlight];
+static GLuint currentSlot = 0;
+static GLuint batchBuffer = 0;
+static GLuint commandBuffer = 0;
+static GLuint countBuffer = 0;
+static vector<CullBatch> batchTable;
+
+static GLuint depthTex = 0;
+static GLuint hizTex = 0;
+static GLint depthWidth = 0;
+static GLint depthHeight = 0;
+static GLint hizWidth = 0;
+static GLint hizHeight = 0;
+static GLint hizLevels = 0;
+static bool hizValid = false;
+static mat4 hizViewProj;
+
+// Largest power of two not above n
+static GLint floor_pow2(GLint n) {
+    GLint p = 1;
+    while (p*2 <= n) {
+        p *= 2;
+    }
+    return p;
+}
+
+// Indirect count draw (core entry point when available)
+static void multi_draw_count(GLintptr indirect, GLintptr drawcount, GLsizei maxdrawcount) {
+#ifdef GLEW_VERSION_4_6
+    if (GLEW_VERSION_4_6) {
+        glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)indirect, drawcount, maxdrawcount, sizeof(DrawCommand));
+        return;
+    }
+#endif
+    glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)indirect, drawcount, maxdrawcount, sizeof(DrawCommand));
+}
+
+bool init_gpu_cull() {
+    bool indirect_count = GLEW_ARB_indirect_parameters;
+#ifdef GLEW_VERSION_4_6
+    indirect_count = indirect_count || GLEW_VERSION_4_6;
+#endif
+    if (!GLEW_VERSION_4_3 || !indirect_count) {
+        printf("GPU culling unavailable, culling on CPU\n");
+        return false;
+    }
+
+    ShaderInfo cull_shaders[] = { {GL_COMPUTE_SHADER, cull_compute_shader},{GL_NONE, NULL} };
+    ShaderInfo hiz_shaders[] = { {GL_COMPUTE_SHADER, hiz_compute_shader},{GL_NONE, NULL} };
+    if (!load_program(cull_program, cull_shaders) || !load_program(hiz_program, hiz_shaders)) {
+        return false;
+    }
+
+    glGenBuffers(1, &objectBuffer);
+    glGenBuffers(1, &drawBuffer);
+    glGenBuffers(1, &idBuffer);
+    glGenBuffers(1, &batchBuffer);
+    glGenBuffers(1, &commandBuffer);
+    glGenBuffers(1, &countBuffer);
+    glGenTextures(1, &depthTex);
+    glGenTextures(1, &hizTex);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlign);
+    return true;
+}
+
+// Bytes rounded up to storage buffer offset alignment
+static GLintptr align_storage(GLintptr size) {
+    return (size + storageAlign - 1)/storageAlign*storageAlign;
+}
+
+// Write range of buffer the GPU is known not to be reading (no driver synchronization)
+static void write_unsynchronized(GLuint buffer, GLintptr offset, const void *data, GLsizeiptr size) {
+    state_bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+    void *dst = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    memcpy(dst, data, size);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    state_bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void set_cull_objects(const CullObject *objects, const DrawObject *draws, GLuint first, GLuint count) {
+    if (first + count > objectCapacity) {
+        GLuint capacity = objectCapacity > 0 ? objectCapacity : 64;
+        while (capacity < first + count) {
+            capacity *= 2;
+        }
+        // Every slot is rewritten from CPU arrays, so grown buffers start empty
+        objectStride = align_storage(sizeof(CullObject)*capacity);
+        drawStride = align_storage(sizeof(DrawObject)*capacity);
+        state_bind_buffer(GL_COPY_WRITE_BUFFER, objectBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, objectStride*FramesInFlight, NULL, GL_DYNAMIC_DRAW);
+        state_bind_buffer(GL_COPY_WRITE_BUFFER, drawBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, drawStride*FramesInFlight, NULL, GL_DYNAMIC_DRAW);
+        state_bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+        cullObjects.resize(capacity);
+        drawObjects.resize(capacity);
+
+        // Object indices fetched per instance (offset by baseInstance of each command)
+        vector<GLuint> ids(capacity);
+        for (GLuint i = 0; i < capacity; i++) {
+            ids[i] = i;
+        }
+        state_bind_buffer(GL_ARRAY_BUFFER, idBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint)*capacity, ids.data(), GL_STATIC_DRAW);
+        state_bind_buffer(GL_ARRAY_BUFFER, 0);
+        objectCapacity = capacity;
+    }
+    copy(objects, objects + count, cullObjects.begin() + first);
+    copy(draws, draws + count, drawObjects.begin() + first);
+    objectCount = max(objectCount, first + count);
+    objectsVersion++;
+}
+
+void set_cull_batches(const CullBatch *batches, GLuint count) {
+    batchTable.assign(batches, batches + count);
+    GLuint commands = 0;
+    for (GLuint b = 0; b < count; b++) {
+        commands += batches[b].maxDraws;
+    }
+    state_bind_buffer(GL_COPY_WRITE_BUFFER, batchBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(CullBatch)*count, batches, GL_STATIC_DRAW);
+    state_bind_buffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(DrawCommand)*(commands > 0 ? commands : 1), NULL, GL_DYNAMIC_DRAW);
+    state_bind_buffer(GL_COPY_WRITE_BUFFER, countBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint)*(count > 0 ? count : 1), NULL, GL_DYNAMIC_DRAW);
+    state_bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void run_gpu_cull(GLuint numObjects, const mat4 &proj, const mat4 &camera, const GLfloat *lodScreenSize) {
+    // Bring this frame's copy of objects up to date (its last reader has finished, see frame_ring.h)
+    currentSlot = frame_slot();
+    if (slotVersion[currentSlot] != objectsVersion && objectCount > 0) {
+        write_unsynchronized(objectBuffer, objectStride*currentSlot, cullObjects.data(), sizeof(CullObject)*objectCount);
+        write_unsynchronized(drawBuffer, drawStride*currentSlot, drawObjects.data(), sizeof(DrawObject)*objectCount);
+    }
+    slotVersion[currentSlot] = objectsVersion;
+
+    // Reset per batch draw counts on GPU
+    state_bind_buffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+    state_use_program(cull_program.id);
+    Frustum frustum;
+    extract_frustum(proj*camera, frustum);
+    glUniform4fv(program_uniform(cull_program, UniPlanes), 6, (const GLfloat *)frustum.planes);
+    glUniform1fv(program_uniform(cull_program, UniLodScreenSize), MaxMeshLods - 1, lodScreenSize);
+    glUniform1f(program_uniform(cull_program, UniProjScale), proj[1][1]);
+    set_uniform(cull_program, UniCameraMatrix, camera);
+    set_uniform(cull_program, UniNumObjects, (GLint)numObjects);
+
+    // Occlusion against last captured pyramid
+    set_uniform(cull_program, UniOcclusion, hizValid ? 1 : 0);
+    if (hizValid) {
+        set_uniform(cull_program, UniHiZViewProj, hizViewProj);
+        glUniform2f(program_uniform(cull_program, UniHiZSize), (GLfloat)hizWidth, (GLfloat)hizHeight);
+        set_uniform(cull_program, UniHiZLevels, hizLevels);
+        set_uniform(cull_program, UniHiZ, (GLint)HiZUnit);
+        state_active_texture(GL_TEXTURE0 + HiZUnit);
+        state_bind_texture(GL_TEXTURE_2D, hizTex);
+        state_active_texture(GL_TEXTURE0);
+    }
+
+    state_bind_buffer_range(GL_SHADER_STORAGE_BUFFER, CullObjectBinding, objectBuffer, objectStride*currentSlot, objectStride);
+    state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, CullBatchBinding, batchBuffer);
+    state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, CullCommandBinding, commandBuffer);
+    state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, CullCountBinding, countBuffer);
+    glDispatchCompute((numObjects + CullGroupSize - 1)/CullGroupSize, 1, 1);
+
+    // Commands and counts are consumed as indirect parameters
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void bind_cull_ids(GLint attrib) {
+    if (attrib < 0) {
+        return;
+    }
+    state_bind_buffer(GL_ARRAY_BUFFER, idBuffer);
+    glVertexAttribIPointer(attrib, 1, GL_UNSIGNED_INT, 0, NULL);
+    glVertexAttribDivisor(attrib, 1);
+    glEnableVertexAttribArray(attrib);
+}
+
+void draw_cull_batch(GLuint batch) {
+    const CullBatch &b = batchTable[batch];
+    if (b.maxDraws == 0) {
+        return;
+    }
+    state_bind_buffer_range(GL_SHADER_STORAGE_BUFFER, DrawObjectBinding, drawBuffer, drawStride*currentSlot, drawStride);
+    state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    state_bind_buffer(GL_PARAMETER_BUFFER_ARB, countBuffer);
+    multi_draw_count(sizeof(DrawCommand)*b.commandBase, sizeof(GLuint)*batch, b.maxDraws);
+    state_bind_buffer(GL_PARAMETER_BUFFER_ARB, 0);
+    state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void update_hiz(GLint width, GLint height, const mat4 &view_proj) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    // Reallocate depth copy and pyramid on resize (pyramid is power of two sized)
+    if (width != depthWidth || height != depthHeight) {
+        state_delete_textures(1, &depthTex);
+        state_delete_textures(1, &hizTex);
+        glGenTextures(1, &depthTex);
+        glGenTextures(1, &hizTex);
+        depthWidth = width;
+        depthHeight = height;
+        hizWidth = floor_pow2(width);
+        hizHeight = floor_pow2(height);
+        hizLevels = (GLint)floor(log2((double)(hizWidth > hizHeight ? hizWidth : hizHeight))) + 1;
+
+        state_active_texture(GL_TEXTURE0 + HiZUnit);
+        state_bind_texture(GL_TEXTURE_2D, depthTex);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+        state_bind_texture(GL_TEXTURE_2D, hizTex);
+        glTexStorage2D(GL_TEXTURE_2D, hizLevels, GL_R32F, hizWidth, hizHeight);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        state_active_texture(GL_TEXTURE0);
+    }
+
+    // Copy depth of read framebuffer
+    state_active_texture(GL_TEXTURE0 + HiZUnit);
+    state_bind_texture(GL_TEXTURE_2D, depthTex);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+    state_active_texture(GL_TEXTURE0);
+
+    // Max reduce into each level from the one above (level 0 from depth copy)
+    state_use_program(hiz_program.id);
+    set_uniform(hiz_program, UniDepthMap, (GLint)HiZUnit);
+    for (GLint level = 0; level < hizLevels; level++) {
+        GLint w = hizWidth >> level > 0 ? hizWidth >> level : 1;
+        GLint h = hizHeight >> level > 0 ? hizHeight >> level : 1;
+        set_uniform(hiz_program, UniLevel, level);
+        if (level > 0) {
+            glBindImageTexture(0, hizTex, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        }
+        glBindImageTexture(1, hizTex, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((w + HiZGroupSize - 1)/HiZGroupSize, (h + HiZGroupSize - 1)/HiZGroupSize, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    hizViewProj = view_proj;
+    hizValid = true;
+}
+
+GLuint gpu_cull_drawn() {
+    vector<GLuint> counts(batchTable.size());
+    if (counts.empty()) {
+        return 0;
+    }
+    state_bind_buffer(GL_COPY_READ_BUFFER, countBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint)*counts.size(), counts.data());
+    state_bind_buffer(GL_COPY_READ_BUFFER, 0);
+    GLuint drawn = 0;
+    for (size_t b = 0; b < counts.size(); b++) {
+        drawn += counts[b];
+    }
+    return drawn;
+}
+
+void destroy_gpu_cull() {
+    state_delete_buffers(1, &objectBuffer);
+    state_delete_buffers(1, &drawBuffer);
+    state_delete_buffers(1, &idBuffer);
+    state_delete_buffers(1, &batchBuffer);
+    state_delete_buffers(1, &commandBuffer);
+    state_delete_buffers(1, &countBuffer);
+    state_delete_textures(1, &depthTex);
+    state_delete_textures(1, &hizTex);
+    state_delete_program(cull_program.id);
+    state_delete_program(hiz_program.id);
+    objectCapacity = 0;
+    objectCount = 0;
+    cullObjects.clear();
+    drawObjects.clear();
+    depthWidth = depthHeight = 0;
+    hizValid = false;
+}
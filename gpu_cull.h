@@ -0,0 +1,77 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef GPU_CULL_H
+#define GPU_CULL_H
+
+#include "../common/vgl.h"
+#include "../common/vmath.h"
+#include "mesh_lod.h"
+
+// GPU culling: compute pass tests objects against frustum and previous frame's Hi-Z pyramid,
+// picks a level of detail and writes indirect draws per mesh batch
+// (needs GL 4.3 compute and indirect count draws, callers keep a CPU path otherwise)
+
+// Batch index of objects not drawn by GPU culling
+const GLuint NoBatch = 0xFFFFFFFF;
+
+// Shader storage bindings
+const GLuint CullObjectBinding = 0;
+const GLuint CullBatchBinding = 1;
+const GLuint CullCommandBinding = 2;
+const GLuint CullCountBinding = 3;
+const GLuint DrawObjectBinding = 4;
+
+// Per object culling input (std430 layout in cull.comp)
+struct CullObject {
+    vmath::vec4 sphere;     // world space center and radius
+    GLuint batch;
+    GLuint pad[3];
+};
+
+// Per batch level of detail ranges and command range (std430 layout in cull.comp)
+struct CullBatch {
+    GLuint lodOffset[MaxMeshLods];
+    GLuint lodCount[MaxMeshLods];
+    GLuint numLods;
+    GLuint commandBase;
+    GLuint maxDraws;
+    GLuint pad;
+};
+
+// Per object draw data read by batched vertex shader through baseInstance (std430 layout)
+struct DrawObject {
+    vmath::mat4 model_matrix;
+    vmath::mat4 normal_matrix;
+    GLint material;
+    GLint pad[3];
+};
+
+// Load culling programs and create buffers (returns false if unsupported)
+bool init_gpu_cull();
+
+// Set objects [first, first + count), copied to frame slot of next cull (buffers grow to hold them)
+void set_cull_objects(const CullObject *objects, const DrawObject *draws, GLuint first, GLuint count);
+
+// Upload batch table
+void set_cull_batches(const CullBatch *batches, GLuint count);
+
+// Cull objects for camera (occlusion uses pyramid from last update_hiz)
+void run_gpu_cull(GLuint numObjects, const vmath::mat4 &proj, const vmath::mat4 &camera, const GLfloat *lodScreenSize);
+
+// Bind per instance object index to attribute of bound vertex array (-1 to skip)
+void bind_cull_ids(GLint attrib);
+
+// Draw commands of batch (program and vertex array bound by caller)
+void draw_cull_batch(GLuint batch);
+
+// Capture depth of current framebuffer into Hi-Z pyramid for next frame's occlusion tests
+void update_hiz(GLint width, GLint height, const vmath::mat4 &view_proj);
+
+// Objects drawn by last cull (reads back counts, so only for statistics)
+GLuint gpu_cull_drawn();
+
+// Release programs and buffers
+void destroy_gpu_cull();
+
+#endif
@@ -3,14 +3,39 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../common/stb_image.h"	// Sean Barrett's image loader - http://nothings.org/
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
 #include <vector>
 #include "../common/vgl.h"
 #include "../common/objloader.h"
-#include "../common/tangentspace.h"
 #include "../common/utils.h"
 #include "../common/vmath.h"
+#include "bvh.h"
+#include "culling.h"
+#include "dynamic_res.h"
+#include "frame_ring.h"
+#include "gl_state.h"
+#include "golden.h"
+#include "gpu_cull.h"
 #include "lighting.h"
+#include "profiler.h"
+#include "program.h"
+#include "staging.h"
+#include "image.h"
+#include "input_log.h"
+#include "mesh_cache.h"
+#include "offscreen.h"
+#include "tangents.h"
+#include "texfile.h"
+#include "thread_pool.h"
+#include "transform.h"
+#include "transform_store.h"
 #define DEG2RAD (M_PI/180.0)
 
 using namespace vmath;
@@ -18,12 +43,14 @@ using namespace std;
 
 // Vertex array and buffer names
 enum VAO_IDs {Cube, TexCube, Cylinder, Cone, Mug, Frame, Mirror, NumVAOs};
-enum ObjBuffer_IDs {PosBuffer, NormBuffer, TexBuffer, TangBuffer, BiTangBuffer, NumObjBuffers};
+enum ObjBuffer_IDs {PosBuffer, NormBuffer, TexBuffer, TangBuffer, IndexBuffer, NumObjBuffers};
 enum Color_Buffer_IDs {WhiteCube, Switch, Walls, BlackMat, BlackCone, WoodFrame, NumColorBuffers};
 enum LightBuffer_IDs {LightBuffer, NumLightBuffers};
 enum MaterialBuffer_IDs {MaterialBuffer, NumMaterialBuffers};
 enum MaterialNames {White, OffWhite, Blue, StandingLight, WoodLining, Glass, Liquid, Tin};
-enum Textures {Blank, Wood, Carpet, Roof, Door, Widow, CarpetNorm, RoofNorm, DoorNorm, WoodNorm, ShadowTex, MirrorTex, NumTextures};
+enum TextureRoles {AlbedoMap, NormalMap, MaskMap};
+enum TangentFrames {VertexFrame, DerivFrame};
+enum Textures {Blank, FlatNorm, Wood, Carpet, Roof, Door, Widow, CarpetNorm, RoofNorm, DoorNorm, WoodNorm, ShadowTex, MirrorTex, NumTextures};
 enum LightNames {WhitePointLight, WhiteSpotLight};
 
 // Vertex array and buffer objects
@@ -33,17 +60,36 @@ GLuint ColorBuffers[NumColorBuffers];
 GLuint LightBuffers[NumLightBuffers];
 GLuint MaterialBuffers[NumMaterialBuffers];
 GLuint TextureIDs[NumTextures];
+// Tangent frame source of each normal map material
+GLuint TangentFrame[NumTextures];
 GLuint ShadowBuffer;
 
 // Number of vertices in each object
 GLint numVertices[NumVAOs];
+// Number of indices in each indexed object (0 if drawn unindexed)
+GLint numIndices[NumVAOs];
+// Level of detail index ranges in each indexed object
+GLint numLods[NumVAOs];
+GLuint lodOffset[NumVAOs][MaxMeshLods];
+GLint lodCount[NumVAOs][MaxMeshLods];
+// Objects with a tangent stream (drawn with a vertex tangent frame normal map somewhere in the scene)
+GLboolean hasTangents[NumVAOs];
+// Object space bounding sphere (center and radius)
+vec4 boundingSphere[NumVAOs];
+// Object space bounding box (min and max corners)
+vec3 boundingBox[NumVAOs][2];
+
+// Projected bounding sphere radius (in NDC) below which each coarser level is used
+const GLfloat LodScreenSize[MaxMeshLods - 1] = {0.25f, 0.12f, 0.06f};
+// Scale on projected size for secondary views (smaller picks coarser levels sooner)
+const GLfloat ShadowLodBias = 0.4f;
+const GLfloat MirrorLodBias = 0.5f;
 
 // Number of component coordinates
 GLint posCoords = 4;
 GLint normCoords = 3;
 GLint texCoords = 2;
-GLint tangCoords = 3;
-GLint bitangCoords = 3;
+GLint tangCoords = 4;
 GLint colCoords = 4;
 
 // Model files
@@ -65,6 +111,154 @@ const char * roofNormFile = "../textures/RoofMap.png";
 const char * doorNormFile = "../textures/DoorMap.png";
 const char * woodNormFile = "../textures/FloorMap.png";
 
+// Texture load request
+struct TextureRequest {
+    const char *filename;
+    GLuint texID;
+    GLuint role;
+    GLint magFilter;
+    GLint minFilter;
+    GLint sWrap;
+    GLint tWrap;
+    bool mipMap;
+    bool invert;
+};
+
+// Streaming state of each texture (unregistered textures such as render targets are bound directly)
+enum TextureStates {TexUnregistered, TexRegistered, TexDecoding, TexStreaming, TexResident, TexFailed};
+struct TextureStream {
+    TextureRequest req;
+    GLuint state;
+    Image image;
+    GLint nextLevel;    // next (finer) mip level to upload
+};
+TextureStream TextureStreams[NumTextures];
+// Textures finished decoding on worker threads
+WorkQueue<GLuint> decodedTextures;
+// Texel bytes uploaded per frame while streaming
+const size_t TextureUploadBudget = 2 << 20;
+
+// Profiler output of --profile runs
+const char *ProfileTracePath = "profile_trace.json";
+const char *ProfileTablePath = "profile_frames.csv";
+
+// Headless --benchmark runs: fixed size offscreen target, frames along scripted camera path
+const GLint BenchWidth = 1280;
+const GLint BenchHeight = 720;
+const int DefaultBenchFrames = 300;
+const int BenchWarmupFrames = 10;
+const GLfloat BenchPathRadius = 4.0f;
+const char *BenchmarkPath = "benchmark.json";
+// Framebuffer of main view (offscreen target without a window)
+GLuint MainFramebuffer = 0;
+GLuint MainRenderbuffers[2];
+// Framebuffer and size the shadow, mirror and main passes render to (scaled target under
+// dynamic resolution, otherwise main framebuffer at full size)
+GLuint ViewFramebuffer = 0;
+GLint rw, rh;
+// GPU frame time budget of dynamic resolution (--frame-budget ms, off when 0)
+GLfloat frameBudget = 0.0f;
+bool dynamicRes = false;
+// Binding calls issued and filtered by state cache in last frame
+StateStats frameState;
+
+// Golden image runs (--golden dir compares with references, --golden-update dir rewrites them):
+// canonical views rendered headless at benchmark size once textures have streamed in
+struct GoldenView {
+    const char *name;
+    vec3 eye;
+    vec3 center;
+    GLfloat blade_ang;
+    GLfloat blinds_ang;
+};
+const GoldenView GoldenViews[] = {
+    {"entrance", vec3(-3.0f, 2.0f, 0.0f), vec3(0.0f, 1.5f, 0.0f), 0.0f, 0.0f},
+    {"mirror", vec3(0.0f, 2.0f, -2.0f), vec3(0.0f, 2.0f, 5.0f), 20.0f, 0.0f},
+    {"window", vec3(0.0f, 2.0f, 2.0f), vec3(0.0f, 2.0f, -5.0f), 0.0f, 30.0f},
+    {"switches", vec3(-2.0f, 2.0f, -3.3f), vec3(-5.0f, 2.0f, -3.3f), 0.0f, 0.0f},
+    {"lamp", vec3(-1.0f, 2.5f, -1.0f), vec3(3.0f, 1.0f, 3.0f), 0.0f, 0.0f},
+    {"fan", vec3(-3.0f, 1.5f, 0.0f), vec3(0.0f, 3.3f, 0.0f), 30.0f, 0.0f},
+};
+const GLuint NumGoldenViews = sizeof(GoldenViews)/sizeof(GoldenViews[0]);
+// Most frames rendered waiting for textures, then frames timed per view
+const int GoldenSettleFrames = 240;
+const int GoldenTimedFrames = 20;
+// Reference frame times kept with images, and report of last run
+const char *GoldenTimingsName = "timings.txt";
+const char *GoldenReportPath = "golden.json";
+const char *GoldenDir = NULL;
+bool goldenUpdate = false;
+
+// Input log written by --record and read by --replay (replays draw every step once)
+const char *RecordPath = NULL;
+const char *ReplayPath = NULL;
+vector<InputEvent> replayInputs;
+size_t replayNext = 0;
+bool replaying = false;
+
+// Worker threads for asset loading and frame preparation
+ThreadPool *worker_pool = NULL;
+
+// Scene objects drawn by render_scene (material is a texture for textured draws)
+enum DrawTypes {MatDraw, TexDraw, BumpDraw, FrameDraw};
+// Scene object flags
+const GLuint HiddenInMirror = 1;
+const GLuint Translucent = 2;
+struct SceneObject {
+    GLuint transform;
+    GLuint obj;
+    GLuint type;
+    GLuint material;
+    GLuint normal_map;
+    GLuint flags;
+    GLuint batch;       // GPU culled batch or NoBatch
+    // World space bounds (refreshed when transform moves)
+    vec4 sphere;
+    vec3 boxMin;
+    vec3 boxMax;
+};
+vector<SceneObject> SceneObjects;
+TransformStore Transforms;
+// Hierarchy over world boxes of scene objects (rebuilt after objects are added)
+Bvh SceneBvh;
+GLboolean sceneBvhStale = true;
+// Animated transforms
+GLuint switchTransforms[3];
+vector<GLuint> blindTransforms;
+GLuint fanTransform;
+
+// Render passes with per pass culling counts of last frame
+enum RenderPasses {MainPass, MirrorPass, ShadowPass, NumPasses};
+const char *passNames[NumPasses] = {"main", "mirror", "shadow"};
+GLuint drawnObjects[NumPasses];
+GLuint culledObjects[NumPasses];
+
+// Per pass view and draw list, built by worker jobs at frame start and replayed by render_scene
+struct PassView {
+    mat4 proj;
+    mat4 camera;
+    GLfloat lodBias;
+};
+struct DrawPacket {
+    GLuint64 key;       // opaque sorted by draw type, material and mesh; translucent last in scene order
+    GLuint object;
+    GLint lod;
+};
+PassView passViews[NumPasses];
+vector<DrawPacket> passPackets[NumPasses];
+vector<GLubyte> passVisible[NumPasses];
+// Level of detail of packet being replayed
+GLint packetLod = 0;
+
+// GPU culling of opaque material objects in main pass (CPU culling when unsupported)
+GLboolean gpuCullSupported = false;
+GLboolean gpuCulling = false;
+// Indirect draws reserved per batch (batches are indexed by object VAO)
+GLuint batchDraws[NumVAOs];
+
+// Camera collision half size
+const GLfloat CameraRadius = 0.2f;
+
 // Camera
 vec3 eye = {-3.0f, 2.0f, 0.0f};
 vec3 center = {0.0f, 0.0f, 0.0f};
@@ -79,10 +273,7 @@ GLfloat elevation = 90.0f;
 GLfloat del = 2.0f;
 GLfloat radius = 2.0f;
 GLfloat dr = 0.1f;
-GLfloat camera_angle = 0.0f;
 GLfloat stepSize = 0.5f;
-GLboolean spin = true;
-GLboolean blinds = false;
 GLfloat swtich1_ang = 45.0f;
 GLfloat swtich2_ang = 45.0f;
 GLfloat swtich3_ang = 45.0f;
@@ -90,122 +281,99 @@ GLfloat blade_ang = 0.0f;
 GLfloat blade_dps = 2.0f;
 GLfloat blinds_ang = 0.0f;
 GLfloat blinds_dps = 360.0f;
-GLfloat spin_dir = 1.0f;
-GLdouble elTime = 0.0;
+
+// Simulation state advanced by input and fixed steps on main thread. The render thread owns
+// the GL context and draws the camera and animation globals above, blended from the last two
+// published steps, so a slow frame neither stalls input nor changes animation speed.
+struct SimState {
+    GLdouble time;          // time of step
+    GLuint64 step;          // steps since start (stamps recorded input)
+    vec3 eye;
+    GLfloat camera_angle;
+    GLboolean spin;
+    GLboolean blinds;
+    GLfloat spin_dir;
+    GLfloat blade_ang;
+    GLfloat blinds_ang;
+    GLfloat switch_angs[3];
+    GLint lightOn[8];
+    GLboolean gpuCulling;
+    GLint width;            // framebuffer size
+    GLint height;
+    GLuint statsRequests;   // statistics read GL queries, so render thread prints them
+};
+const GLdouble SimStep = 1.0/60.0;
+// Steps run at most to catch up after a stall (later ones are dropped)
+const int MaxSimSteps = 5;
+SimState sim;
+// Previous and latest published steps
+SimState snapshots[2];
+mutex snapshotMutex;
+// Render on demand: frames owed after a visible change (guarded by snapshotMutex). A change
+// owes two frames so occlusion culling from the previous frame catches up; the render thread
+// also keeps drawing until its blend reaches the latest step and streamed textures are complete.
+const GLuint FramesAfterChange = 2;
+GLuint framesOwed = 0;
+condition_variable frameWanted;
+// Input, resize or exposure changed simulation since last published step (main thread)
+bool simChanged = false;
+atomic<bool> windowIconified(false);
+// Held by render thread while it updates scene hierarchy and views read by input queries
+mutex sceneMutex;
+atomic<bool> rendering(false);
+GLuint statsPrinted = 0;
 
 // Shader variables
 // Default (color) shader program references
-GLuint default_program;
-GLuint default_vPos;
-GLuint default_vCol;
-GLuint default_proj_mat_loc;
-GLuint default_cam_mat_loc;
-GLuint default_model_mat_loc;
+ShaderProgram default_program;
 const char *default_vertex_shader = "../default.vert";
 const char *default_frag_shader = "../default.frag";
 
 // Lighting shader program reference
-GLuint lighting_program;
-GLuint lighting_vPos;
-GLuint lighting_vNorm;
-GLuint lighting_camera_mat_loc;
-GLuint lighting_model_mat_loc;
-GLuint lighting_proj_mat_loc;
-GLuint lighting_norm_mat_loc;
-GLuint lighting_lights_block_idx;
-GLuint lighting_materials_block_idx;
-GLuint lighting_material_loc;
-GLuint lighting_num_lights_loc;
-GLuint lighting_light_on_loc;
-GLuint lighting_eye_loc;
+ShaderProgram lighting_program;
 const char *lighting_vertex_shader = "../lighting.vert";
 const char *lighting_frag_shader = "../lighting.frag";
 
 // Light shader program with shadows reference
-GLuint phong_shadow_program;
-GLuint phong_shadow_vPos;
-GLuint phong_shadow_vNorm;
-GLuint phong_shadow_proj_mat_loc;
-GLuint phong_shadow_camera_mat_loc;
-GLuint phong_shadow_norm_mat_loc;
-GLuint phong_shadow_model_mat_loc;
-GLuint phong_shadow_shad_proj_mat_loc;
-GLuint phong_shadow_shad_cam_mat_loc;
-GLuint phong_shadow_lights_block_idx;
-GLuint phong_shadow_materials_block_idx;
-GLuint phong_shadow_material_loc;
-GLuint phong_shadow_num_lights_loc;
-GLuint phong_shadow_light_on_loc;
-GLuint phong_shadow_eye_loc;
+ShaderProgram phong_shadow_program;
 const char *phong_shadow_vertex_shader = "../phongShadow.vert";
 const char *phong_shadow_frag_shader = "../phongShadow.frag";
 
 // Texture shader program reference
-GLuint texture_program;
-GLuint texture_vPos;
-GLuint texture_vTex;
-GLuint texture_proj_mat_loc;
-GLuint texture_camera_mat_loc;
-GLuint texture_model_mat_loc;
+ShaderProgram texture_program;
 const char *texture_vertex_shader = "../texture.vert";
 const char *texture_frag_shader = "../texture.frag";
 
 // Shadow shader program reference
-GLuint shadow_program;
-GLuint shadow_vPos;
-GLuint shadow_proj_mat_loc;
-GLuint shadow_camera_mat_loc;
-GLuint shadow_model_mat_loc;
+ShaderProgram shadow_program;
 const char *shadow_vertex_shader = "../shadow.vert";
 const char *shadow_frag_shader = "../shadow.frag";
 
 // Bumpmapping shader program reference
-GLuint bump_program;
-GLuint bump_proj_mat_loc;
-GLuint bump_camera_mat_loc;
-GLuint bump_norm_mat_loc;
-GLuint bump_model_mat_loc;
-GLuint bump_vPos;
-GLuint bump_vNorm;
-GLuint bump_vTex;
-GLuint bump_vTang;
-GLuint bump_vBiTang;
-GLuint bump_lights_block_idx;
-GLuint bump_num_lights_loc;
-GLuint bump_light_on_loc;
-GLuint bump_eye_loc;
-GLuint bump_base_loc;
-GLuint bump_norm_loc;
+ShaderProgram bump_program;
 const char *bump_vertex_shader = "../bumpTex.vert";
 const char *bump_frag_shader = "../bumpTex.frag";
 
 // BumpShadow shader program reference
-GLuint bumpShadow_program;
-GLuint bumpShadow_proj_mat_loc;
-GLuint bumpShadow_camera_mat_loc;
-GLuint bumpShadow_norm_mat_loc;
-GLuint bumpShadow_model_mat_loc;
-GLuint bumpShadow_vPos;
-GLuint bumpShadow_vNorm;
-GLuint bumpShadow_vTex;
-GLuint bumpShadow_vTang;
-GLuint bumpShadow_vBiTang;
-GLuint bumpShadow_lights_block_idx;
-GLuint bumpShadow_num_lights_loc;
-GLuint bumpShadow_light_on_loc;
-GLuint bumpShadow_eye_loc;
-GLuint bumpShadow_base_loc;
-GLuint bumpShadow_norm_loc;
-GLuint bumpShadow_shadow_loc;
-GLuint bumpShadow_shad_proj_mat_loc;
-GLuint bumpShadow_shad_cam_mat_loc;
-GLuint bumpShadow_materials_block_idx;
-GLuint bumpShadow_material_loc;
+ShaderProgram bumpShadow_program;
 const char *bumpShadow_vertex_shader = "../bumpShadow.vert";
 const char *bumpShadow_frag_shader = "../bumpShadow.frag";
 
+// Bump shader program with tangent frames from screen space derivatives
+ShaderProgram bumpDeriv_program;
+
+// Tangent frame modules linked into bump programs (vertex tangent stream or derivatives)
+const char *vertex_frame_vertex_shader = "../vertexFrame.vert";
+const char *vertex_frame_frag_shader = "../vertexFrame.frag";
+const char *deriv_frame_vertex_shader = "../derivFrame.vert";
+const char *deriv_frame_frag_shader = "../derivFrame.frag";
+
+// Batched light shader with shadows for GPU culled draws
+ShaderProgram phongShadowBatch_program;
+const char *phong_shadow_batch_vertex_shader = "../phongShadowBatch.vert";
+
 // Debug shadow program reference
-GLuint debug_program;
+ShaderProgram debug_program;
 const char *debug_shadow_vertex_shader = "../debugShadow.vert";
 const char *debug_shadow_frag_shader = "../debugShadow.frag";
 
@@ -214,11 +382,9 @@ GLuint shadow = false;
 
 // Mirror flag
 GLboolean mirror = false;
-
-// Generic shader variables references
-GLuint vPos;
-GLuint vNorm;
-GLuint model_mat_loc;
+// Size of mirror texture storage
+GLint mirrorWidth = 0;
+GLint mirrorHeight = 0;
 
 // Global state
 mat4 proj_matrix;
@@ -238,6 +404,34 @@ GLint ww,hh;
 
 void display();
 void render_scene();
+void build_scene();
+void update_scene();
+void prepare_frame();
+void start_sim(GLdouble now);
+bool step_sim();
+void advance_sim(GLdouble now);
+bool apply_snapshot();
+void request_frames();
+void show_sim();
+void submit_input(GLint type, GLfloat x = 0.0f, GLfloat y = 0.0f, GLfloat z = 0.0f);
+void apply_input(const InputEvent &event);
+bool replay_step();
+void render_loop(GLFWwindow *window);
+void run_replay(GLFWwindow *window);
+void render_frame();
+void shutdown_renderer();
+void build_main_target(GLint width, GLint height);
+void run_benchmark(int frames);
+int run_golden();
+void read_main_target(ImageLevel &image);
+void build_pass_packets(GLuint pass);
+void print_cull_stats();
+void build_gpu_culling();
+void upload_cull_object(GLuint index);
+void draw_gpu_culled();
+bool camera_blocked(const vec3 &pos);
+void toggle_switch(int sw);
+void add_object(GLuint transform, GLuint obj, GLuint type, GLuint material, GLuint normal_map = 0, GLuint flags = 0);
 void create_shadows( );
 void create_mirror( );
 void build_geometry();
@@ -250,7 +444,17 @@ void build_textures();
 void build_texture_cube(GLuint obj);
 void build_shadows( );
 void load_model(const char * filename, GLuint obj);
-void load_texture(const char * filename, GLuint texID, GLint magFilter, GLint minFilter, GLint sWrap, GLint tWrap, bool mipMap, bool invert);
+void compute_bounds(const vector<vec4> &vertices, GLuint obj);
+void register_textures(const TextureRequest *requests, GLuint count);
+void load_texture(GLuint texture);
+void request_texture(GLuint texture);
+void bind_texture(GLuint texture);
+void stream_textures();
+bool textures_settled();
+void allocate_texture(const TextureRequest &req, const Image &image);
+void upload_texture_level(const TextureRequest &req, const Image &image, GLint level);
+GLint select_lod(GLuint obj, const mat4 &model, const PassView &view);
+void draw_triangles(GLuint obj);
 void draw_color_obj(GLuint obj, GLuint color);
 void draw_mat_object(GLuint obj, GLuint material);
 void draw_tex_object(GLuint obj, GLuint texture);
@@ -258,149 +462,178 @@ void draw_bump_object(GLuint obj, GLuint base_texture, GLuint normal_map);
 void draw_bump_shadow_object(GLuint obj, GLuint base_texture, GLuint normal_map);
 void draw_frame(GLuint obj);
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
+void window_iconify_callback(GLFWwindow *window, int iconified);
+void window_refresh_callback(GLFWwindow *window);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 void mouse_callback(GLFWwindow *window, int button, int action, int mods);
 void renderQuad();
 
 int main(int argc, char**argv)
 {
-	// Create OpenGL window
-	GLFWwindow* window = CreateWindow("Think Inside The Box");
-    if (!window) {
-        fprintf(stderr, "ERROR: could not open window with GLFW3\n");
-        glfwTerminate();
-        return 1;
+    // Options: --profile writes timing traces, --benchmark [frames] renders headless,
+    // --record file logs input and --replay file plays a log back (headless with --benchmark),
+    // --golden dir checks canonical views against reference images (--golden-update dir rewrites them),
+    // --frame-budget ms scales main view resolution to keep GPU frame time within budget
+    bool profiling = false;
+    int benchFrames = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--profile") == 0) {
+            profiling = true;
+        } else if (strcmp(argv[i], "--benchmark") == 0) {
+            benchFrames = DefaultBenchFrames;
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                benchFrames = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            RecordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            ReplayPath = argv[++i];
+        } else if ((strcmp(argv[i], "--golden") == 0 || strcmp(argv[i], "--golden-update") == 0) && i + 1 < argc) {
+            goldenUpdate = strcmp(argv[i], "--golden-update") == 0;
+            GoldenDir = argv[++i];
+        } else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc) {
+            frameBudget = (GLfloat)atof(argv[++i]);
+        }
+    }
+
+    // Replays run to end of log (benchmarks time every recorded step)
+    if (ReplayPath) {
+        if (!load_input_log(ReplayPath, replayInputs)) {
+            return 1;
+        }
+        if (replayInputs.empty()) {
+            fprintf(stderr, "ERROR: input log %s is empty\n", ReplayPath);
+            return 1;
+        }
+        replaying = true;
+        if (benchFrames > 0) {
+            benchFrames = max((int)replayInputs.back().step, 1);
+        }
+    }
+
+    GLFWwindow* window = NULL;
+    bool headless = benchFrames > 0 || GoldenDir;
+    if (headless) {
+        // Offscreen context and target (no window system needed)
+        if (!create_offscreen_context()) {
+            return 1;
+        }
+        ww = BenchWidth;
+        hh = BenchHeight;
+        build_main_target(ww, hh);
     } else {
-        printf("OpenGL window successfully created\n");
+        // Create OpenGL window
+        window = CreateWindow("Think Inside The Box");
+        if (!window) {
+            fprintf(stderr, "ERROR: could not open window with GLFW3\n");
+            glfwTerminate();
+            return 1;
+        } else {
+            printf("OpenGL window successfully created\n");
+        }
+
+        // Store initial window size
+        glfwGetFramebufferSize(window, &ww, &hh);
+
+        // Register callbacks
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetWindowIconifyCallback(window, window_iconify_callback);
+        glfwSetWindowRefreshCallback(window, window_refresh_callback);
+        glfwSetKeyCallback(window,key_callback);
+        glfwSetMouseButtonCallback(window, mouse_callback);
     }
 
-    // Store initial window size
-    glfwGetFramebufferSize(window, &ww, &hh);
+    // Record startup and frame timings (benchmarks and golden runs keep totals only)
+    if (profiling) {
+        init_profiler(ProfileTracePath, ProfileTablePath);
+    } else if (headless) {
+        init_profiler(NULL, NULL);
+    }
+    set_profile_thread("main");
 
-    // Register callbacks
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetKeyCallback(window,key_callback);
-    glfwSetMouseButtonCallback(window, mouse_callback);
+    profile_begin("load_shaders");
 
-    // Load shaders and associate variables
+    // Load shaders (uniforms, blocks and attributes are reflected at link time)
     ShaderInfo default_shaders[] = { {GL_VERTEX_SHADER, default_vertex_shader},{GL_FRAGMENT_SHADER, default_frag_shader},{GL_NONE, NULL} };
-    default_program = LoadShaders(default_shaders);
-    default_vPos = glGetAttribLocation(default_program, "vPosition");
-    default_vCol = glGetAttribLocation(default_program, "vColor");
-    default_proj_mat_loc = glGetUniformLocation(default_program, "proj_matrix");
-    default_cam_mat_loc = glGetUniformLocation(default_program, "camera_matrix");
-    default_model_mat_loc = glGetUniformLocation(default_program, "model_matrix");
-
-    // Load shaders
+    load_program(default_program, default_shaders);
+
     // Load light shader
     ShaderInfo lighting_shaders[] = { {GL_VERTEX_SHADER, lighting_vertex_shader},{GL_FRAGMENT_SHADER, lighting_frag_shader},{GL_NONE, NULL} };
-    lighting_program = LoadShaders(lighting_shaders);
-    lighting_vPos = glGetAttribLocation(lighting_program, "vPosition");
-    lighting_vNorm = glGetAttribLocation(lighting_program, "vNormal");
-    lighting_proj_mat_loc = glGetUniformLocation(lighting_program, "proj_matrix");
-    lighting_camera_mat_loc = glGetUniformLocation(lighting_program, "camera_matrix");
-    lighting_norm_mat_loc = glGetUniformLocation(lighting_program, "normal_matrix");
-    lighting_model_mat_loc = glGetUniformLocation(lighting_program, "model_matrix");
-    lighting_lights_block_idx = glGetUniformBlockIndex(lighting_program, "LightBuffer");
-    lighting_materials_block_idx = glGetUniformBlockIndex(lighting_program, "MaterialBuffer");
-    lighting_material_loc = glGetUniformLocation(lighting_program, "Material");
-    lighting_num_lights_loc = glGetUniformLocation(lighting_program, "NumLights");
-    lighting_light_on_loc = glGetUniformLocation(lighting_program, "LightOn");
-    lighting_eye_loc = glGetUniformLocation(lighting_program, "EyePosition");
+    load_program(lighting_program, lighting_shaders);
+    bind_program_block(lighting_program, "LightBuffer", 0);
+    bind_program_block(lighting_program, "MaterialBuffer", 1);
 
     // Load light shader with shadows
     ShaderInfo phong_shadow_shaders[] = { {GL_VERTEX_SHADER, phong_shadow_vertex_shader},{GL_FRAGMENT_SHADER, phong_shadow_frag_shader},{GL_NONE, NULL} };
-    phong_shadow_program = LoadShaders(phong_shadow_shaders);
-    phong_shadow_vPos = glGetAttribLocation(phong_shadow_program, "vPosition");
-    phong_shadow_vNorm = glGetAttribLocation(phong_shadow_program, "vNormal");
-    phong_shadow_camera_mat_loc = glGetUniformLocation(phong_shadow_program, "camera_matrix");
-    phong_shadow_proj_mat_loc = glGetUniformLocation(phong_shadow_program, "proj_matrix");
-    phong_shadow_norm_mat_loc = glGetUniformLocation(phong_shadow_program, "normal_matrix");
-    phong_shadow_model_mat_loc = glGetUniformLocation(phong_shadow_program, "model_matrix");
-    phong_shadow_shad_proj_mat_loc = glGetUniformLocation(phong_shadow_program, "light_proj_matrix");
-    phong_shadow_shad_cam_mat_loc = glGetUniformLocation(phong_shadow_program, "light_cam_matrix");
-    phong_shadow_lights_block_idx = glGetUniformBlockIndex(phong_shadow_program, "LightBuffer");
-    phong_shadow_materials_block_idx = glGetUniformBlockIndex(phong_shadow_program, "MaterialBuffer");
-    phong_shadow_material_loc = glGetUniformLocation(phong_shadow_program, "Material");
-    phong_shadow_num_lights_loc = glGetUniformLocation(phong_shadow_program, "NumLights");
-    phong_shadow_light_on_loc = glGetUniformLocation(phong_shadow_program, "LightOn");
-    phong_shadow_eye_loc = glGetUniformLocation(phong_shadow_program, "EyePosition");
+    load_program(phong_shadow_program, phong_shadow_shaders);
+    bind_program_block(phong_shadow_program, "LightBuffer", 0);
+    bind_program_block(phong_shadow_program, "MaterialBuffer", 1);
 
     // Load shadow shader
     ShaderInfo shadow_shaders[] = { {GL_VERTEX_SHADER, shadow_vertex_shader},{GL_FRAGMENT_SHADER, shadow_frag_shader},{GL_NONE, NULL} };
-    shadow_program = LoadShaders(shadow_shaders);
-    shadow_vPos = glGetAttribLocation(shadow_program, "vPosition");
-    shadow_proj_mat_loc = glGetUniformLocation(shadow_program, "light_proj_matrix");
-    shadow_camera_mat_loc = glGetUniformLocation(shadow_program, "light_cam_matrix");
-    shadow_model_mat_loc = glGetUniformLocation(shadow_program, "model_matrix");
+    load_program(shadow_program, shadow_shaders);
 
     // Load texture shaders
     ShaderInfo texture_shaders[] = { {GL_VERTEX_SHADER, texture_vertex_shader},{GL_FRAGMENT_SHADER, texture_frag_shader},{GL_NONE, NULL} };
-    texture_program = LoadShaders(texture_shaders);
-    texture_vPos = glGetAttribLocation(texture_program, "vPosition");
-    texture_vTex = glGetAttribLocation(texture_program, "vTexCoord");
-    texture_proj_mat_loc = glGetUniformLocation(texture_program, "proj_matrix");
-    texture_camera_mat_loc = glGetUniformLocation(texture_program, "camera_matrix");
-    texture_model_mat_loc = glGetUniformLocation(texture_program, "model_matrix");
+    load_program(texture_program, texture_shaders);
 
     // Load bump shader
-    ShaderInfo bump_shaders[] = { {GL_VERTEX_SHADER, bump_vertex_shader},{GL_FRAGMENT_SHADER, bump_frag_shader},{GL_NONE, NULL} };
-    bump_program = LoadShaders(bump_shaders);
-    bump_vPos = glGetAttribLocation(bump_program, "vPosition");
-    bump_vNorm = glGetAttribLocation(bump_program, "vNormal");
-    bump_vTex = glGetAttribLocation(bump_program, "vTexCoord");
-    bump_vTang = glGetAttribLocation(bump_program, "vTangent");
-    bump_vBiTang = glGetAttribLocation(bump_program, "vBiTangent");
-    bump_proj_mat_loc = glGetUniformLocation(bump_program, "proj_matrix");
-    bump_camera_mat_loc = glGetUniformLocation(bump_program, "camera_matrix");
-    bump_norm_mat_loc = glGetUniformLocation(bump_program, "normal_matrix");
-    bump_model_mat_loc = glGetUniformLocation(bump_program, "model_matrix");
-    bump_lights_block_idx = glGetUniformBlockIndex(bump_program, "LightBuffer");
-    bump_num_lights_loc = glGetUniformLocation(bump_program, "NumLights");
-    bump_light_on_loc = glGetUniformLocation(bump_program, "LightOn");
-    bump_eye_loc = glGetUniformLocation(bump_program, "EyePosition");
-    bump_base_loc = glGetUniformLocation(bump_program, "baseMap");
-    bump_norm_loc = glGetUniformLocation(bump_program, "normalMap");
-
-    ShaderInfo bumpShadow_shaders[] = { {GL_VERTEX_SHADER, bumpShadow_vertex_shader},{GL_FRAGMENT_SHADER, bumpShadow_frag_shader},{GL_NONE, NULL} };
-    bumpShadow_program = LoadShaders(bumpShadow_shaders);
-    bumpShadow_proj_mat_loc = glGetAttribLocation(bumpShadow_program, "proj_matrix");
-    bumpShadow_camera_mat_loc = glGetAttribLocation(bumpShadow_program, "camera_matrix");
-    bumpShadow_norm_mat_loc = glGetAttribLocation(bumpShadow_program, "normal_matrix");
-    bumpShadow_model_mat_loc = glGetAttribLocation(bumpShadow_program, "model_matrix");
-    bumpShadow_vPos = glGetAttribLocation(bumpShadow_program, "vPosition");
-    bumpShadow_vNorm = glGetAttribLocation(bumpShadow_program, "vNorm");
-    bumpShadow_vTex = glGetAttribLocation(bumpShadow_program, "vTexCoord");
-    bumpShadow_vTang = glGetAttribLocation(bumpShadow_program, "vTangent");
-    bumpShadow_vBiTang = glGetAttribLocation(bumpShadow_program, "vBiTangent");
-    bumpShadow_lights_block_idx = glGetAttribLocation(bumpShadow_program, "LightBuffer");
-    bumpShadow_num_lights_loc = glGetAttribLocation(bumpShadow_program, "NumLights");
-    bumpShadow_light_on_loc = glGetAttribLocation(bumpShadow_program, "LightOn");
-    bumpShadow_eye_loc = glGetAttribLocation(bumpShadow_program, "EyePosition");
-    bumpShadow_base_loc = glGetAttribLocation(bumpShadow_program, "baseMap");
-    bumpShadow_norm_loc = glGetAttribLocation(bumpShadow_program, "normalMap");
-    bumpShadow_norm_loc = glGetAttribLocation(bumpShadow_program, "shadowMap");
-    bumpShadow_shad_proj_mat_loc = glGetAttribLocation(bumpShadow_program, "light_proj_matrix");
-    bumpShadow_shad_cam_mat_loc = glGetAttribLocation(bumpShadow_program, "light_cam_matrix");
-    bumpShadow_materials_block_idx = glGetAttribLocation(bumpShadow_program, "MaterialBuffer");
-    bumpShadow_material_loc = glGetAttribLocation(bumpShadow_program, "Material");
+    ShaderInfo bump_shaders[] = { {GL_VERTEX_SHADER, bump_vertex_shader},{GL_VERTEX_SHADER, vertex_frame_vertex_shader},
+                                  {GL_FRAGMENT_SHADER, bump_frag_shader},{GL_FRAGMENT_SHADER, vertex_frame_frag_shader},{GL_NONE, NULL} };
+    load_program(bump_program, bump_shaders);
+    bind_program_block(bump_program, "LightBuffer", 0);
+
+    // Load bump shader with derivative tangent frames
+    ShaderInfo bumpDeriv_shaders[] = { {GL_VERTEX_SHADER, bump_vertex_shader},{GL_VERTEX_SHADER, deriv_frame_vertex_shader},
+                                       {GL_FRAGMENT_SHADER, bump_frag_shader},{GL_FRAGMENT_SHADER, deriv_frame_frag_shader},{GL_NONE, NULL} };
+    load_program(bumpDeriv_program, bumpDeriv_shaders);
+    bind_program_block(bumpDeriv_program, "LightBuffer", 0);
+
+    // Load bump shader with shadows
+    ShaderInfo bumpShadow_shaders[] = { {GL_VERTEX_SHADER, bumpShadow_vertex_shader},{GL_VERTEX_SHADER, vertex_frame_vertex_shader},
+                                        {GL_FRAGMENT_SHADER, bumpShadow_frag_shader},{GL_FRAGMENT_SHADER, vertex_frame_frag_shader},{GL_NONE, NULL} };
+    load_program(bumpShadow_program, bumpShadow_shaders);
+    bind_program_block(bumpShadow_program, "LightBuffer", 0);
+    bind_program_block(bumpShadow_program, "MaterialBuffer", 1);
 
     // Load debug shadow shader
     ShaderInfo debug_shaders[] = { {GL_VERTEX_SHADER, debug_shadow_vertex_shader},{GL_FRAGMENT_SHADER, debug_shadow_frag_shader},{GL_NONE, NULL} };
-    debug_program = LoadShaders(debug_shaders);
+    load_program(debug_program, debug_shaders);
+    profile_end();
+
+    // Start asset loading workers
+    worker_pool = new ThreadPool();
 
+    // Create textures (and tangent frame of each normal map)
+    profile_begin("build_textures");
+    build_textures();
+    profile_end();
+    // Create scene objects and transforms (geometry uses them to pick tangent streams)
+    profile_begin("build_scene");
+    build_scene();
+    profile_end();
     // Create geometry buffers
+    profile_begin("build_geometry");
     build_geometry();
+    profile_end();
     // Create material buffers
     build_materials();
     // Create light buffers
     build_lights();
-    // Create textures
-    build_textures();
     // Create shadow buffer
     build_shadows();
     // Create mirror texture
     build_mirror(MirrorTex);
+    // Place objects now that their bounds are known
+    profile_begin("build_gpu_culling");
+    update_scene();
+    // Set up GPU culling batches if supported
+    build_gpu_culling();
+    profile_end();
+    // Scale main view to frame budget (golden images always render at full size)
+    if (frameBudget > 0.0f && !GoldenDir) {
+        dynamicRes = init_dynamic_res(frameBudget);
+    }
 
     // Enable depth test
     glEnable(GL_CULL_FACE);
@@ -410,442 +643,1048 @@ int main(int argc, char**argv)
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // Start loop
-    while ( !glfwWindowShouldClose( window ) ) {
-        glCullFace(GL_FRONT);
-        create_shadows();
-        glCullFace(GL_BACK);
-        center[0] = eye[0] + cos(camera_angle);
-        center[1] = eye[1];
-        center[2] = eye[2] + sin(camera_angle);
-
-        create_mirror();
-    	// Draw graphics
-//    	renderQuad();
-        display();
-        // Update other events like input handling
-        glfwPollEvents();
+    if (GoldenDir) {
+        int result = run_golden();
+        delete worker_pool;
+        destroy_offscreen_context();
+        return result;
+    }
+    if (benchFrames > 0) {
+        run_benchmark(benchFrames);
+        delete worker_pool;
+        destroy_offscreen_context();
+        return 0;
+    }
 
-        //animation
-        GLdouble curTime = glfwGetTime();
-        if (spin) {
-            blade_ang += (curTime - elTime) * (blade_dps / 60.0) * 360.0f;
+    start_sim(glfwGetTime());
+    if (replaying) {
+        // Draw every step on this thread so frames match recording one for one
+        run_replay(window);
+    } else {
+        if (RecordPath) {
+            start_input_record(RecordPath);
         }
 
-        if (blinds) {
-            blinds_ang += spin_dir * (curTime - elTime) * (blinds_dps);
-            if (blinds_ang <= 0.0f || blinds_ang >= 55.0f) {
-                blinds = false;
-                spin_dir *= -1;
+        // Hand GL context to render thread; this thread handles input and simulation
+        glfwMakeContextCurrent(NULL);
+        rendering = true;
+        thread renderer(render_loop, window);
+
+        while ( !glfwWindowShouldClose( window ) ) {
+            if ((sim.spin || sim.blinds || simChanged) && !windowIconified) {
+                // Sleep until next step is due unless input arrives first
+                GLdouble wait = sim.time + SimStep - glfwGetTime();
+                glfwWaitEventsTimeout(wait > 0.0 ? wait : 0.0);
+            } else {
+                // Nothing moves (or nothing is shown): sleep until input
+                glfwWaitEvents();
             }
+            advance_sim(glfwGetTime());
         }
-        elTime = curTime;
 
-        // Swap buffer onto screen
-        glfwSwapBuffers( window );
+        // Stop rendering before closing window
+        {
+            lock_guard<mutex> lock(snapshotMutex);
+            rendering = false;
+        }
+        frameWanted.notify_one();
+        renderer.join();
+        stop_input_record(sim.step);
     }
 
     // Close window
+    delete worker_pool;
     glfwTerminate();
     return 0;
 
 }
 
-void display( )
-{
-    // Declare projection and camera matrices
-    proj_matrix = mat4().identity();
-    camera_matrix = mat4().identity();
+void render_loop(GLFWwindow *window) {
+    glfwMakeContextCurrent(window);
+    set_profile_thread("render");
+    while (true) {
+        // Sleep while nothing changed or window is minimized
+        {
+            unique_lock<mutex> lock(snapshotMutex);
+            frameWanted.wait(lock, [] { return !rendering || (framesOwed > 0 && !windowIconified); });
+            if (!rendering) {
+                break;
+            }
+        }
 
-	// Clear window and depth buffer
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // Blend latest simulation steps into camera and animation state
+        bool caught_up = apply_snapshot();
+        render_frame();
 
-    // Compute anisotropic scaling
-    GLfloat xratio = 1.0f;
-    GLfloat yratio = 1.0f;
-    // If taller than wide adjust y
-    if (ww <= hh)
-    {
-        yratio = (GLfloat)hh / (GLfloat)ww;
+        // Swap buffer onto screen
+        profile_begin("swap");
+        glfwSwapBuffers( window );
+        profile_end();
+        profile_frame();
+
+        lock_guard<mutex> lock(snapshotMutex);
+        if (caught_up && textures_settled()) {
+            framesOwed--;
+        } else if (framesOwed < 1) {
+            framesOwed = 1;
+        }
+    }
+
+    // Release GL objects while context is still current
+    shutdown_renderer();
+    glfwMakeContextCurrent(NULL);
+}
+
+// Render one frame per logged step with a fixed clock (live input other than quitting is ignored)
+void run_replay(GLFWwindow *window) {
+    set_profile_thread("render");
+    while (!glfwWindowShouldClose(window) && replay_step()) {
+        glfwPollEvents();
+        show_sim();
+        render_frame();
+
+        profile_begin("swap");
+        glfwSwapBuffers( window );
+        profile_end();
+        profile_frame();
+    }
+    shutdown_renderer();
+}
+
+// Flush profiler and release streaming and culling objects (GL thread)
+void shutdown_renderer( ) {
+    destroy_frame_ring();
+    if (dynamicRes) {
+        destroy_dynamic_res();
+    }
+    shutdown_profiler();
+    destroy_staging();
+    if (gpuCullSupported) {
+        destroy_gpu_cull();
+    }
+}
+
+// Render all passes of current camera and animation state
+void render_frame( ) {
+    // Reuse per frame resources of the frame FramesInFlight back once the GPU is done with them
+    profile_begin("frame_wait");
+    begin_frame_slot();
+    profile_end();
+    // Size of main view this frame
+    if (dynamicRes) {
+        begin_dynamic_frame(ww, hh, rw, rh);
+        ViewFramebuffer = dynamic_framebuffer();
+    } else {
+        rw = ww;
+        rh = hh;
+        ViewFramebuffer = MainFramebuffer;
     }
-        // If wider than tall adjust x
-    else if (hh <= ww)
     {
-        xratio = (GLfloat)ww / (GLfloat)hh;
+        lock_guard<mutex> lock(sceneMutex);
+        // Update transforms of animated objects
+        profile_begin("update_scene", true);
+        update_scene();
+        profile_end();
+        // Cull and sort draws of every pass on worker threads
+        profile_begin("prepare_frame");
+        prepare_frame();
+        profile_end();
     }
 
-    // DEFAULT ORTHOGRAPHIC PROJECTION
-    proj_matrix = frustum(-0.1f*xratio, 0.1f*xratio, -0.1f*yratio, 0.1f*yratio, 0.1f, 20.0f);
+    profile_begin("create_shadows", true);
+    glCullFace(GL_FRONT);
+    create_shadows();
+    glCullFace(GL_BACK);
+    profile_end();
+    profile_begin("create_mirror", true);
+    create_mirror();
+    profile_end();
+	// Draw graphics
+//	renderQuad();
+    profile_begin("display", true);
+    display();
+    profile_end();
+    // Keep depth of main view for next frame's occlusion culling
+    if (gpuCulling) {
+        profile_begin("update_hiz", true);
+        update_hiz(rw, rh, proj_matrix*camera_matrix);
+        profile_end();
+    }
 
-    // Set camera matrix
-    camera_matrix = lookat(eye, center, up);
+    // Upload textures requested by draws this frame
+    profile_begin("stream_textures", true);
+    stream_textures();
+    // Recycle texture staging buffers whose uploads have completed
+    poll_staging();
+    profile_end();
+
+    // Stretch scaled main view over output
+    if (dynamicRes) {
+        profile_begin("upscale", true);
+        end_dynamic_frame(MainFramebuffer);
+        profile_end();
+    }
+    end_frame_slot();
 
-    // Render objects
-	render_scene();
+    // Binding calls of this frame
+    state_stats(frameState);
+    reset_state_stats();
+}
 
-	// Flush pipeline
-	glFlush();
+// Color and depth renderbuffers standing in for window framebuffer
+void build_main_target(GLint width, GLint height) {
+    glGenFramebuffers(1, &MainFramebuffer);
+    glGenRenderbuffers(2, MainRenderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, MainRenderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, MainRenderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, MainFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, MainRenderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, MainRenderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "ERROR: offscreen framebuffer incomplete\n");
+    }
+    glViewport(0, 0, width, height);
 }
 
-void render_scene( ) {
-    // Declare transformation matrices
-    model_matrix = mat4().identity();
-    mat4 scale_matrix = mat4().identity();
-    mat4 rot_matrix = mat4().identity();
-    mat4 trans_matrix = mat4().identity();
+// Nearest rank percentile of sorted values
+static double percentile(const vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = (size_t)ceil(p/100.0*sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
 
-    // Set cube transformation matrix
-    // floor
-    scale_matrix = scale(11.0f, 0.5f, 11.0f);
-	model_matrix = scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+// Render frames along a circle around the room looking at its center, or the steps of a replayed
+// input log, and write timings as JSON
+void run_benchmark(int frames) {
+    set_profile_thread("render");
+    start_sim(0.0);
+    StateStats calls = StateStats();
+    for (int i = 0; i < BenchWarmupFrames + frames; i++) {
+        if (i == BenchWarmupFrames) {
+            reset_profile_stats();
+        }
+        if (replaying) {
+            // Warm up on first step, then one frame per recorded step
+            if (i >= BenchWarmupFrames && !replay_step()) {
+                break;
+            }
+            show_sim();
+        } else {
+            GLfloat a = 2.0f*M_PI*i/frames;
+            eye = vec3(BenchPathRadius*cos(a), 2.0f, BenchPathRadius*sin(a));
+            center = eye + vec3(-cos(a), 0.0f, -sin(a));
+            // Animation advances by fixed steps so every run draws the same frames
+            blade_ang = i*SimStep*(blade_dps/60.0)*360.0f;
+        }
+        render_frame();
+
+        // Wait for GPU so frame times include rendering
+        profile_begin("finish");
+        glFinish();
+        profile_end();
+        profile_frame();
+        if (i >= BenchWarmupFrames) {
+            for (GLuint c = 0; c < NumStateCalls; c++) {
+                calls.issued[c] += frameState.issued[c];
+                calls.filtered[c] += frameState.filtered[c];
+            }
+        }
+    }
+    shutdown_renderer();
+
+    vector<ProfileStat> stats;
+    vector<double> times;
+    profile_stats(stats, times);
+    sort(times.begin(), times.end());
+    double total = 0.0;
+    for (size_t i = 0; i < times.size(); i++) {
+        total += times[i];
     }
-    draw_bump_object(TexCube, Carpet, CarpetNorm);
+    double mean = times.empty() ? 0.0 : total/times.size();
 
-    //walls
-    trans_matrix = translate(5.5f, 2.0f, 0.0f);
-    scale_matrix = scale(0.5f, 4.0f, 11.0f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    FILE *out = fopen(BenchmarkPath, "w");
+    if (!out) {
+        fprintf(stderr, "ERROR: could not write %s\n", BenchmarkPath);
+        return;
     }
-    draw_mat_object(Cube, Blue);
-    trans_matrix = translate(-5.5f, 2.0f, 0.0f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    fprintf(out, "{\n  \"renderer\": \"%s\",\n", glGetString(GL_RENDERER));
+    fprintf(out, "  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %u,\n  \"gpu_culling\": %s,\n",
+            ww, hh, (GLuint)times.size(), gpuCulling ? "true" : "false");
+    if (replaying) {
+        fprintf(out, "  \"replay\": \"%s\",\n", ReplayPath);
     }
-    draw_mat_object(Cube, Blue);
-    trans_matrix = translate(0.0f, 2.0f, 5.5f);
-    scale_matrix = scale(11.0f, 4.0f, 0.5f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    fprintf(out, "  \"frame_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n",
+            mean, percentile(times, 50.0), percentile(times, 95.0), percentile(times, 99.0),
+            times.empty() ? 0.0 : times.back());
+    // Mean cost of each scope occurrence (GPU time only where timer queries ran)
+    fprintf(out, "  \"scopes\": [");
+    for (size_t i = 0; i < stats.size(); i++) {
+        const ProfileStat &s = stats[i];
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"count\": %u, \"cpu_ms\": %.4f", i ? "," : "", s.name, s.cpuCount,
+                s.cpuCount ? s.cpuTotal/s.cpuCount : 0.0);
+        if (s.gpuCount > 0) {
+            fprintf(out, ", \"gpu_ms\": %.4f", s.gpuTotal/s.gpuCount);
+        }
+        fprintf(out, "}");
     }
-    draw_mat_object(Cube, Blue);
-    trans_matrix = translate(0.0f, 2.0f, -5.5f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    fprintf(out, "\n  ],\n");
+    // Binding calls per frame reaching GL and dropped as redundant
+    fprintf(out, "  \"gl_calls\": [");
+    GLuint measured = times.empty() ? 1 : (GLuint)times.size();
+    for (GLuint c = 0; c < NumStateCalls; c++) {
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"issued\": %.1f, \"filtered\": %.1f}", c ? "," : "",
+                state_call_name(c), (double)calls.issued[c]/measured, (double)calls.filtered[c]/measured);
     }
-    draw_mat_object(Cube, Blue);
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+    printf("Benchmark: %u frames, mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms (%s)\n",
+           (GLuint)times.size(), mean, percentile(times, 50.0), percentile(times, 95.0), percentile(times, 99.0),
+           BenchmarkPath);
+}
 
-    // roof
-    trans_matrix = translate(0.0f, 4.0f, 0.0f);
-    scale_matrix = scale(11.0f, 0.5f, 11.0f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+// RGB rows of main target top to bottom
+void read_main_target(ImageLevel &image) {
+    image.width = ww;
+    image.height = hh;
+    image.pixels.resize((size_t)ww*hh*3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, MainFramebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, ww, hh, GL_RGB, GL_UNSIGNED_BYTE, image.pixels.data());
+    flip_image_rows(image.pixels.data(), ww, hh, 3);
+}
+
+// Render canonical views and compare them with references in GoldenDir (or replace them),
+// writing differences and frame times per view; returns exit code (non-zero if a view differs
+// or has no reference image; frame times are only reported since they depend on the host)
+int run_golden( ) {
+    set_profile_thread("render");
+    char path[1024];
+
+    bool failed = goldenUpdate && !make_golden_dir(GoldenDir);
+
+    // Frame times recorded with references
+    vector<double> referenceMs(NumGoldenViews, 0.0);
+    snprintf(path, sizeof(path), "%s/%s", GoldenDir, GoldenTimingsName);
+    FILE *timings = fopen(path, goldenUpdate ? "w" : "r");
+    if (timings && !goldenUpdate) {
+        char name[64];
+        double ms;
+        while (fscanf(timings, "%63s %lf", name, &ms) == 2) {
+            for (GLuint v = 0; v < NumGoldenViews; v++) {
+                if (strcmp(name, GoldenViews[v].name) == 0) {
+                    referenceMs[v] = ms;
+                }
+            }
+        }
+    } else if (!timings && goldenUpdate) {
+        fprintf(stderr, "ERROR: could not write %s\n", path);
+        failed = true;
+    } else if (!timings) {
+        fprintf(stderr, "WARNING: no reference frame times %s\n", path);
     }
-    draw_bump_object(TexCube, Roof, RoofNorm);
 
-    //table
-    trans_matrix = translate(0.0f, 1.5f, 0.0f);
-    scale_matrix = scale(2.0f, 0.3f, 2.0f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    FILE *report = fopen(GoldenReportPath, "w");
+    if (report) {
+        fprintf(report, "{\n  \"renderer\": \"%s\",\n  \"views\": [", glGetString(GL_RENDERER));
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
-    trans_matrix = translate(0.85f, 1.0f, 0.85f);
-    scale_matrix = scale(0.3f, 1.0f, 0.3f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    GLuint reported = 0;
+    for (GLuint v = 0; v < NumGoldenViews; v++) {
+        const GoldenView &view = GoldenViews[v];
+        eye = view.eye;
+        center = view.center;
+        blade_ang = view.blade_ang;
+        blinds_ang = view.blinds_ang;
+
+        // Still view lets textures finish streaming and occlusion culling settle
+        for (int i = 0; i < GoldenSettleFrames; i++) {
+            render_frame();
+            glFinish();
+            profile_frame();
+            if (i > 0 && textures_settled()) {
+                break;
+            }
+        }
+        reset_profile_stats();
+        for (int i = 0; i < GoldenTimedFrames; i++) {
+            render_frame();
+            glFinish();
+            profile_frame();
+        }
+        vector<ProfileStat> stats;
+        vector<double> times;
+        profile_stats(stats, times);
+        double ms = 0.0;
+        for (size_t i = 0; i < times.size(); i++) {
+            ms += times[i]/times.size();
+        }
+
+        ImageLevel image;
+        read_main_target(image);
+        snprintf(path, sizeof(path), "%s/%s.ppm", GoldenDir, view.name);
+        if (goldenUpdate) {
+            failed |= !write_ppm(path, image);
+            if (timings) {
+                fprintf(timings, "%s %.4f\n", view.name, ms);
+            }
+            if (report) {
+                fprintf(report, "%s\n    {\"name\": \"%s\", \"frame_ms\": %.4f}", reported++ ? "," : "", view.name, ms);
+            }
+            continue;
+        }
+
+        FILE *exists = fopen(path, "rb");
+        if (!exists) {
+            fprintf(stderr, "ERROR: no reference %s (create with --golden-update)\n", path);
+            failed = true;
+            continue;
+        }
+        fclose(exists);
+        ImageLevel reference;
+        ImageLevel highlight;
+        ImageDiff diff = {(GLuint)(image.width*image.height), 1.0f, 1.0f};
+        bool match = false;
+        if (read_golden(path, reference)) {
+            if (reference.width == image.width && reference.height == image.height) {
+                diff = compare_images(image, reference, &highlight);
+                match = images_match(diff, image);
+            } else {
+                fprintf(stderr, "ERROR: reference %s is %dx%d, render is %dx%d\n", path, reference.width, reference.height,
+                        image.width, image.height);
+            }
+        }
+        // Keep render and changed pixels of mismatches for inspection
+        if (!match) {
+            failed = true;
+            snprintf(path, sizeof(path), "%s_out.ppm", view.name);
+            write_ppm(path, image);
+            if (!highlight.pixels.empty()) {
+                snprintf(path, sizeof(path), "%s_diff.ppm", view.name);
+                write_ppm(path, highlight);
+            }
+        }
+        // Frame time relative to reference (0 if none recorded)
+        double ratio = referenceMs[v] > 0.0 ? ms/referenceMs[v] : 0.0;
+        printf("%-10s %s  %u pixels changed, %.3f ms (reference %.3f ms, ratio %.2f)\n", view.name,
+               match ? "match" : "DIFFERS", diff.changed, ms, referenceMs[v], ratio);
+        if (report) {
+            fprintf(report, "%s\n    {\"name\": \"%s\", \"match\": %s, \"changed\": %u, \"mean_delta\": %.5f, "
+                    "\"max_delta\": %.5f, \"frame_ms\": %.4f, \"reference_ms\": %.4f, \"time_ratio\": %.3f}", reported++ ? "," : "",
+                    view.name, match ? "true" : "false", diff.changed, diff.meanDelta, diff.maxDelta, ms, referenceMs[v],
+                    ratio);
+        }
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
-    trans_matrix = translate(-0.85f, 1.0f, 0.85f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    if (timings) {
+        fclose(timings);
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
-    trans_matrix = translate(-0.85f, 1.0f, -0.85f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    if (report) {
+        fprintf(report, "\n  ]\n}\n");
+        fclose(report);
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
-    trans_matrix = translate(0.85f, 1.0f, -0.85f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    shutdown_renderer();
+    return failed ? 1 : 0;
+}
+
+void start_sim(GLdouble now) {
+    sim.time = now;
+    sim.step = 0;
+    sim.eye = eye;
+    sim.camera_angle = 0.0f;
+    sim.spin = true;
+    sim.blinds = false;
+    sim.spin_dir = 1.0f;
+    sim.blade_ang = blade_ang;
+    sim.blinds_ang = blinds_ang;
+    sim.switch_angs[0] = swtich1_ang;
+    sim.switch_angs[1] = swtich2_ang;
+    sim.switch_angs[2] = swtich3_ang;
+    for (int i = 0; i < 8; i++) {
+        sim.lightOn[i] = lightOn[i];
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
+    sim.gpuCulling = gpuCulling;
+    sim.width = ww;
+    sim.height = hh;
+    sim.statsRequests = 0;
+    snapshots[0] = sim;
+    snapshots[1] = sim;
+    framesOwed = FramesAfterChange;
+}
 
-    //can
-    trans_matrix = translate(0.5f, 1.9f, 0.5f);
-    scale_matrix = scale(0.2f, 0.23f, 0.2f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+// Advance animation by one fixed step (returns whether anything moved)
+bool step_sim( ) {
+    sim.time += SimStep;
+    sim.step++;
+    bool moved = sim.spin || sim.blinds;
+
+    //animation
+    if (sim.spin) {
+        sim.blade_ang += SimStep * (blade_dps / 60.0) * 360.0f;
     }
-    draw_mat_object(Cylinder, Tin);
 
-    //draw chair
-    trans_matrix = translate(0.9f, 1.0f, 0.0f);
-    scale_matrix = scale(1.0f, 0.1f, 1.0f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    if (sim.blinds) {
+        sim.blinds_ang += sim.spin_dir * SimStep * (blinds_dps);
+        if (sim.blinds_ang <= 0.0f || sim.blinds_ang >= 55.0f) {
+            sim.blinds = false;
+            sim.spin_dir *= -1;
+        }
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
-    trans_matrix = translate(1.35f, 1.0f, 0.45f);
-    scale_matrix = scale(0.1f, 2.0f, 0.1f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    return moved;
+}
+
+void advance_sim(GLdouble now) {
+    if (now - sim.time > MaxSimSteps*SimStep) {
+        sim.time = now - MaxSimSteps*SimStep;
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
-    trans_matrix = translate(1.35f, 1.0f, -0.45f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    while (sim.time + SimStep <= now) {
+        bool changed = step_sim() || simChanged;
+        simChanged = false;
+
+        // Publish step (render thread keeps blending from the one before)
+        lock_guard<mutex> lock(snapshotMutex);
+        snapshots[0] = snapshots[1];
+        snapshots[1] = sim;
+        if (changed) {
+            framesOwed = FramesAfterChange;
+            frameWanted.notify_one();
+        }
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
-    trans_matrix = translate(0.45f, 0.7f, 0.45f);
-    scale_matrix = scale(0.1f, 0.5f, 0.1f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+}
+
+// Draw next published step (main thread, e.g. after exposure or restore)
+void request_frames( ) {
+    simChanged = true;
+}
+
+// Blend published steps into render globals (returns whether blend reached latest step)
+bool apply_snapshot( ) {
+    SimState prev, next;
+    {
+        lock_guard<mutex> lock(snapshotMutex);
+        prev = snapshots[0];
+        next = snapshots[1];
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
-    trans_matrix = translate(0.45f, 0.7f, -0.45f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    // Draw one step behind so a frame always lies between two published steps
+    GLfloat t = 1.0f;
+    if (next.time > prev.time) {
+        t = (GLfloat)((glfwGetTime() - SimStep - prev.time)/(next.time - prev.time));
+        t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
-    trans_matrix = translate(1.35f, 1.7f, 0.0f);
-    scale_matrix = scale(0.0f, 0.6f, 1.0f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    eye = prev.eye + (next.eye - prev.eye)*t;
+    GLfloat angle = prev.camera_angle + (next.camera_angle - prev.camera_angle)*t;
+    center = eye + vec3(cos(angle), 0.0f, sin(angle));
+    blade_ang = prev.blade_ang + (next.blade_ang - prev.blade_ang)*t;
+    blinds_ang = prev.blinds_ang + (next.blinds_ang - prev.blinds_ang)*t;
+
+    // Switches and toggles follow latest step
+    swtich1_ang = next.switch_angs[0];
+    swtich2_ang = next.switch_angs[1];
+    swtich3_ang = next.switch_angs[2];
+    for (int i = 0; i < 8; i++) {
+        lightOn[i] = next.lightOn[i];
+    }
+    gpuCulling = next.gpuCulling;
+    if (next.width != ww || next.height != hh) {
+        ww = next.width;
+        hh = next.height;
+        glViewport(0, 0, ww, hh);
+    }
+    if (next.statsRequests != statsPrinted) {
+        statsPrinted = next.statsRequests;
+        print_cull_stats();
     }
-    draw_bump_object(TexCube, Wood, WoodNorm);
+    return t >= 1.0f;
+}
 
-    //standing light
-    trans_matrix = translate(3.0f, 1.0f, 3.0f);
-    scale_matrix = scale(0.15f, 1.0f, 0.15f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
-    }
-    draw_mat_object(Cylinder, StandingLight);
-    trans_matrix = translate(3.0f, 1.9f, 3.0f);
-    rot_matrix = rotate(180.0f, vec3(0.0f, 0.0f, 1.0f));
-    scale_matrix = scale(0.3f, 0.3f, 0.3f);
-    model_matrix = trans_matrix*rot_matrix*scale_matrix;
-    rot_matrix = rotate(90.0f, 1.0f, 0.0f, 1.0f);
-    model_matrix *= rot_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+// Draw latest step as is (no blending) on GL thread
+void show_sim( ) {
+    {
+        lock_guard<mutex> lock(snapshotMutex);
+        snapshots[0] = sim;
+        snapshots[1] = sim;
     }
-    draw_mat_object(Cone, StandingLight);
-    trans_matrix = translate(3.0f, 0.45f, 3.0f);
-    scale_matrix = scale(0.4f, 0.1f, 0.4f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    apply_snapshot();
+}
+
+// Apply live input to simulation, logging it when recording
+void submit_input(GLint type, GLfloat x, GLfloat y, GLfloat z) {
+    if (replaying) {
+        return;
     }
-    draw_mat_object(Cone, StandingLight);
+    InputEvent event = {sim.step, type, {x, y, z}};
+    record_input(event);
+    apply_input(event);
+    simChanged = true;
+}
 
-    //light switch
-    trans_matrix = translate(-5.2f, 2.0f, -3.3f);
-    scale_matrix = scale(0.2f, 1.0f, 1.7f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
-    }
-    draw_mat_object(Cube, White);
-    trans_matrix = translate(-5.1f, 2.1f, -3.3f);
-    rot_matrix = rotate(swtich1_ang, vec3(0.0f, 0.0f, 1.0f));
-    scale_matrix = scale(0.7f, 0.3f, 0.3f);
-    model_matrix = trans_matrix*rot_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
-    }
-    draw_mat_object(Cube, OffWhite);
-    trans_matrix = translate(-5.1f, 2.1f, -2.7f);
-    rot_matrix = rotate(swtich2_ang, vec3(0.0f, 0.0f, 1.0f));
-    scale_matrix = scale(0.7f, 0.3f, 0.3f);
-    model_matrix = trans_matrix*rot_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
-    }
-    draw_mat_object(Cube, OffWhite);
-    trans_matrix = translate(-5.1f, 2.1f, -3.9f);
-    rot_matrix = rotate(swtich3_ang, vec3(0.0f, 0.0f, 1.0f));
-    scale_matrix = scale(0.7f, 0.3f, 0.3f);
-    model_matrix = trans_matrix*rot_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+void apply_input(const InputEvent &event) {
+    switch (event.type) {
+        case TurnInput:
+            sim.camera_angle += event.value[0];
+            break;
+        case MoveInput:
+            sim.eye = vec3(event.value[0], event.value[1], event.value[2]);
+            break;
+        case SwitchInput:
+            toggle_switch((int)event.value[0]);
+            break;
+        case BlindsInput:
+            sim.blinds = !sim.blinds;
+            break;
+        case CullingInput:
+            if (gpuCullSupported) {
+                sim.gpuCulling = !sim.gpuCulling;
+                printf("%s culling\n", sim.gpuCulling ? "GPU" : "CPU");
+            }
+            break;
+        case StatsInput:
+            sim.statsRequests++;
+            break;
     }
-    draw_mat_object(Cube, OffWhite);
+}
 
-    //door
-    trans_matrix = translate(-5.1f, 1.5f, 0.0f);
-    rot_matrix = rotate(180.0f, 1.0f, 0.0f, 0.0f);
-    scale_matrix = scale(0.1f, 4.0f, 2.0f);
-    model_matrix = trans_matrix*rot_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+// Apply logged inputs of current step and advance one step (false at end of log)
+bool replay_step( ) {
+    while (replayNext < replayInputs.size() && replayInputs[replayNext].step == sim.step) {
+        if (replayInputs[replayNext].type == EndInput) {
+            return false;
+        }
+        apply_input(replayInputs[replayNext++]);
     }
-    draw_bump_object(TexCube, Door, DoorNorm);
+    if (replayNext == replayInputs.size()) {
+        return false;
+    }
+    step_sim();
+    return true;
+}
 
-    //window
-    trans_matrix = translate(0.0f, 2.0f, -5.25f);
-    rot_matrix = rotate(180.0f, 0.0f, 0.0f, 1.0f);
-    scale_matrix = scale(2.0f, 2.0f, 0.1f);
-    model_matrix = trans_matrix*rot_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+void display( )
+{
+    // Main view projection and camera
+    proj_matrix = passViews[MainPass].proj;
+    camera_matrix = passViews[MainPass].camera;
+
+	// Clear window and depth buffer
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Render objects
+	render_scene();
+}
+
+void prepare_frame( ) {
+    // Shadow view from first light
+    vec3 leye = {Lights[0].position[0], Lights[0].position[1], Lights[0].position[2]};
+    vec3 ldir = {Lights[0].direction[0], Lights[0].direction[1], Lights[0].direction[2]};
+    vec3 lup = {0.0f, 1.0f, 0.0f};
+    passViews[ShadowPass].proj = frustum(-1.0, 1.0, -1.0, 1.0, 1.0, 20.0);
+    passViews[ShadowPass].camera = lookat(leye, leye + ldir, lup);
+    passViews[ShadowPass].lodBias = ShadowLodBias;
+
+    // Fixed mirror view
+    passViews[MirrorPass].proj = frustum(-0.2f, 0.2f, -0.2f, 0.2f, 0.2f, 100.0f);
+    passViews[MirrorPass].camera = lookat(mirror_eye, mirror_center, mirror_up);
+    passViews[MirrorPass].lodBias = MirrorLodBias;
+
+    // Compute anisotropic scaling
+    GLfloat xratio = 1.0f;
+    GLfloat yratio = 1.0f;
+    // If taller than wide adjust y
+    if (ww <= hh)
+    {
+        yratio = (GLfloat)hh / (GLfloat)ww;
     }
-    draw_tex_object(TexCube, Widow);
-    trans_matrix = translate(1.0f, 2.0f, -5.25f);
-    scale_matrix = scale(0.3f, 2.3f, 0.5f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+        // If wider than tall adjust x
+    else if (hh <= ww)
+    {
+        xratio = (GLfloat)ww / (GLfloat)hh;
     }
-    draw_mat_object(Cube, WoodLining);
-    trans_matrix = translate(-1.0f, 2.0f, -5.25f);
-    scale_matrix = scale(0.3f, 2.3f, 0.5f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    passViews[MainPass].proj = frustum(-0.1f*xratio, 0.1f*xratio, -0.1f*yratio, 0.1f*yratio, 0.1f, 20.0f);
+    passViews[MainPass].camera = lookat(eye, center, up);
+    passViews[MainPass].lodBias = 1.0f;
+
+    // One job per pass (each splits its objects further)
+    parallel_for(worker_pool, NumPasses, [](size_t begin, size_t end) {
+        for (size_t pass = begin; pass < end; pass++) {
+            build_pass_packets(pass);
+        }
+    }, 1);
+}
+
+// Cull scene objects against pass view and build its sorted draw list (no GL calls, runs on workers)
+void build_pass_packets(GLuint pass) {
+    profile_begin("build_pass_packets");
+    const PassView &view = passViews[pass];
+    Frustum frustum;
+    extract_frustum(view.proj*view.camera, frustum);
+    vector<GLubyte> &visible = passVisible[pass];
+    visible.assign(SceneObjects.size(), 0);
+    SceneBvh.query_frustum(frustum, visible);
+
+    // Opaque material objects of main view are culled and drawn on GPU
+    GLboolean gpu = gpuCulling && pass == MainPass;
+
+    // Packet per object slot (negative lod marks skipped or culled objects), compacted afterwards
+    vector<DrawPacket> slots(SceneObjects.size());
+    parallel_for(worker_pool, SceneObjects.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const SceneObject &o = SceneObjects[i];
+            DrawPacket &p = slots[i];
+            p.object = i;
+            p.lod = -1;
+            // Skip mirror and its frame when rendering the mirror view
+            if (pass == MirrorPass && (o.flags & HiddenInMirror)) {
+                continue;
+            }
+            if (gpu && o.batch != NoBatch) {
+                continue;
+            }
+            if (!visible[i]) {
+                p.lod = -2;
+                continue;
+            }
+            p.lod = select_lod(o.obj, Transforms.world(o.transform), view);
+            if (o.flags & Translucent) {
+                p.key = (GLuint64)1 << 63;
+            } else {
+                p.key = (GLuint64)o.type << 48 | (GLuint64)o.material << 32 | (GLuint64)o.normal_map << 16 | o.obj;
+            }
+        }
+    }, 64);
+
+    vector<DrawPacket> &packets = passPackets[pass];
+    packets.clear();
+    culledObjects[pass] = 0;
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (slots[i].lod >= 0) {
+            packets.push_back(slots[i]);
+        } else if (slots[i].lod == -2) {
+            culledObjects[pass]++;
+        }
     }
-    draw_mat_object(Cube, WoodLining);
-    trans_matrix = translate(0.0f, 3.0f, -5.25f);
-    scale_matrix = scale(2.0f, 0.3f, 0.5f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    drawnObjects[pass] = packets.size();
+    // Fewer program and texture changes; equal keys keep scene order
+    sort(packets.begin(), packets.end(), [](const DrawPacket &a, const DrawPacket &b) {
+        return a.key != b.key ? a.key < b.key : a.object < b.object;
+    });
+    profile_end();
+}
+
+void render_scene( ) {
+    // Replay draw list of current pass
+    GLuint pass = shadow ? ShadowPass : mirror ? MirrorPass : MainPass;
+    if (gpuCulling && pass == MainPass) {
+        draw_gpu_culled();
     }
-    draw_mat_object(Cube, WoodLining);
-    trans_matrix = translate(0.0f, 1.0f, -5.25f);
-    scale_matrix = scale(2.0f, 0.3f, 0.5f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+
+    const vector<DrawPacket> &packets = passPackets[pass];
+    for (size_t i = 0; i < packets.size(); i++) {
+        const SceneObject &o = SceneObjects[packets[i].object];
+        model_matrix = Transforms.world(o.transform);
+        normal_matrix = Transforms.normal(o.transform);
+        packetLod = packets[i].lod;
+        // Translucent objects do not write depth
+        if (o.flags & Translucent) {
+            glDepthMask(GL_FALSE);
+        }
+        switch (o.type) {
+            case MatDraw:
+                draw_mat_object(o.obj, o.material);
+                break;
+            case TexDraw:
+                draw_tex_object(o.obj, o.material);
+                break;
+            case BumpDraw:
+                draw_bump_object(o.obj, o.material, o.normal_map);
+                break;
+            case FrameDraw:
+                draw_frame(o.obj);
+                break;
+        }
+        if (o.flags & Translucent) {
+            glDepthMask(GL_TRUE);
+        }
+    }
+}
+
+void add_object(GLuint transform, GLuint obj, GLuint type, GLuint material, GLuint normal_map, GLuint flags) {
+    SceneObject o = {transform, obj, type, material, normal_map, flags, NoBatch};
+    SceneObjects.push_back(o);
+    sceneBvhStale = true;
+}
+
+void build_scene( ) {
+    GLuint t;
+    vec4 ident = NoRotation;
+
+    // floor
+    t = Transforms.add(vec3(0.0f, 0.0f, 0.0f), ident, vec3(11.0f, 0.5f, 11.0f));
+    add_object(t, TexCube, BumpDraw, Carpet, CarpetNorm);
+
+    //walls
+    t = Transforms.add(vec3(5.5f, 2.0f, 0.0f), ident, vec3(0.5f, 4.0f, 11.0f));
+    add_object(t, Cube, MatDraw, Blue);
+    t = Transforms.add(vec3(-5.5f, 2.0f, 0.0f), ident, vec3(0.5f, 4.0f, 11.0f));
+    add_object(t, Cube, MatDraw, Blue);
+    t = Transforms.add(vec3(0.0f, 2.0f, 5.5f), ident, vec3(11.0f, 4.0f, 0.5f));
+    add_object(t, Cube, MatDraw, Blue);
+    t = Transforms.add(vec3(0.0f, 2.0f, -5.5f), ident, vec3(11.0f, 4.0f, 0.5f));
+    add_object(t, Cube, MatDraw, Blue);
+
+    // roof
+    t = Transforms.add(vec3(0.0f, 4.0f, 0.0f), ident, vec3(11.0f, 0.5f, 11.0f));
+    add_object(t, TexCube, BumpDraw, Roof, RoofNorm);
+
+    //table
+    t = Transforms.add(vec3(0.0f, 1.5f, 0.0f), ident, vec3(2.0f, 0.3f, 2.0f));
+    add_object(t, TexCube, BumpDraw, Wood, WoodNorm);
+    const GLfloat legs[4][2] = {{0.85f, 0.85f}, {-0.85f, 0.85f}, {-0.85f, -0.85f}, {0.85f, -0.85f}};
+    for (int i = 0; i < 4; i++) {
+        t = Transforms.add(vec3(legs[i][0], 1.0f, legs[i][1]), ident, vec3(0.3f, 1.0f, 0.3f));
+        add_object(t, TexCube, BumpDraw, Wood, WoodNorm);
+    }
+
+    //can
+    t = Transforms.add(vec3(0.5f, 1.9f, 0.5f), ident, vec3(0.2f, 0.23f, 0.2f));
+    add_object(t, Cylinder, MatDraw, Tin);
+
+    //chair
+    t = Transforms.add(vec3(0.9f, 1.0f, 0.0f), ident, vec3(1.0f, 0.1f, 1.0f));
+    add_object(t, TexCube, BumpDraw, Wood, WoodNorm);
+    t = Transforms.add(vec3(1.35f, 1.0f, 0.45f), ident, vec3(0.1f, 2.0f, 0.1f));
+    add_object(t, TexCube, BumpDraw, Wood, WoodNorm);
+    t = Transforms.add(vec3(1.35f, 1.0f, -0.45f), ident, vec3(0.1f, 2.0f, 0.1f));
+    add_object(t, TexCube, BumpDraw, Wood, WoodNorm);
+    t = Transforms.add(vec3(0.45f, 0.7f, 0.45f), ident, vec3(0.1f, 0.5f, 0.1f));
+    add_object(t, TexCube, BumpDraw, Wood, WoodNorm);
+    t = Transforms.add(vec3(0.45f, 0.7f, -0.45f), ident, vec3(0.1f, 0.5f, 0.1f));
+    add_object(t, TexCube, BumpDraw, Wood, WoodNorm);
+    t = Transforms.add(vec3(1.35f, 1.7f, 0.0f), ident, vec3(0.0f, 0.6f, 1.0f));
+    add_object(t, TexCube, BumpDraw, Wood, WoodNorm);
+
+    //standing light
+    t = Transforms.add(vec3(3.0f, 1.0f, 3.0f), ident, vec3(0.15f, 1.0f, 0.15f));
+    add_object(t, Cylinder, MatDraw, StandingLight);
+    // Shade is tilted in its own frame under a flipped pivot
+    t = Transforms.add(vec3(3.0f, 1.9f, 3.0f), axis_angle(180.0f, vec3(0.0f, 0.0f, 1.0f)), vec3(1.0f, 1.0f, 1.0f));
+    t = Transforms.add(vec3(0.0f, 0.0f, 0.0f), axis_angle(90.0f, vec3(1.0f, 0.0f, 1.0f)), vec3(0.3f, 0.3f, 0.3f), t);
+    add_object(t, Cone, MatDraw, StandingLight);
+    t = Transforms.add(vec3(3.0f, 0.45f, 3.0f), ident, vec3(0.4f, 0.1f, 0.4f));
+    add_object(t, Cone, MatDraw, StandingLight);
+
+    //light switch
+    t = Transforms.add(vec3(-5.2f, 2.0f, -3.3f), ident, vec3(0.2f, 1.0f, 1.7f));
+    add_object(t, Cube, MatDraw, White);
+    const GLfloat switches[3] = {-3.3f, -2.7f, -3.9f};
+    for (int i = 0; i < 3; i++) {
+        switchTransforms[i] = Transforms.add(vec3(-5.1f, 2.1f, switches[i]), ident, vec3(0.7f, 0.3f, 0.3f));
+        add_object(switchTransforms[i], Cube, MatDraw, OffWhite);
     }
-    draw_mat_object(Cube, WoodLining);
+
+    //door
+    t = Transforms.add(vec3(-5.1f, 1.5f, 0.0f), axis_angle(180.0f, vec3(1.0f, 0.0f, 0.0f)), vec3(0.1f, 4.0f, 2.0f));
+    add_object(t, TexCube, BumpDraw, Door, DoorNorm);
+
+    //window
+    t = Transforms.add(vec3(0.0f, 2.0f, -5.25f), axis_angle(180.0f, vec3(0.0f, 0.0f, 1.0f)), vec3(2.0f, 2.0f, 0.1f));
+    add_object(t, TexCube, TexDraw, Widow);
+    t = Transforms.add(vec3(1.0f, 2.0f, -5.25f), ident, vec3(0.3f, 2.3f, 0.5f));
+    add_object(t, Cube, MatDraw, WoodLining);
+    t = Transforms.add(vec3(-1.0f, 2.0f, -5.25f), ident, vec3(0.3f, 2.3f, 0.5f));
+    add_object(t, Cube, MatDraw, WoodLining);
+    t = Transforms.add(vec3(0.0f, 3.0f, -5.25f), ident, vec3(2.0f, 0.3f, 0.5f));
+    add_object(t, Cube, MatDraw, WoodLining);
+    t = Transforms.add(vec3(0.0f, 1.0f, -5.25f), ident, vec3(2.0f, 0.3f, 0.5f));
+    add_object(t, Cube, MatDraw, WoodLining);
 
     //blinds
     for (float i = 3.0f; i > 1.0f; i -= 0.1f) {
-        trans_matrix = translate(0.0f, i, -5.1f);
-        scale_matrix = scale(1.68f, 0.05f, 0.1f);
-        rot_matrix = rotate(blinds_ang, 1.0f, 0.0f, 0.0f);
-        model_matrix = trans_matrix*rot_matrix*scale_matrix;
-        if (!shadow) {
-            // Set normal matrix for phong shadow shader
-            normal_matrix = model_matrix.inverse().transpose();
-        }
-        draw_mat_object(Cube, White);
+        t = Transforms.add(vec3(0.0f, i, -5.1f), ident, vec3(1.68f, 0.05f, 0.1f));
+        blindTransforms.push_back(t);
+        add_object(t, Cube, MatDraw, White);
     }
 
     //fan
-    trans_matrix = translate(0.0f, 3.3f, 0.0f);
-    scale_matrix = scale(0.15f, 0.1f, 0.15f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    t = Transforms.add(vec3(0.0f, 3.3f, 0.0f), ident, vec3(0.15f, 0.1f, 0.15f));
+    add_object(t, Cylinder, MatDraw, StandingLight);
+    t = Transforms.add(vec3(0.0f, 3.1f, 0.0f), ident, vec3(0.5f, 0.05f, 0.5f));
+    add_object(t, Cylinder, MatDraw, StandingLight);
+
+    //fan blades spin with an unscaled pivot
+    fanTransform = Transforms.add(vec3(0.0f, 3.1f, 0.0f), ident, vec3(1.0f, 1.0f, 1.0f));
+    for (int i = 0; i < 2; i++) {
+        t = Transforms.add(vec3(0.0f, 0.0f, 0.0f), axis_angle(90.0f * i, vec3(0.0f, 1.0f, 0.0f)), vec3(2.65f, 0.05f, 0.4f), fanTransform);
+        add_object(t, Cube, MatDraw, WoodLining);
     }
-    draw_mat_object(Cylinder, StandingLight);
-    trans_matrix = translate(0.0f, 3.1f, 0.0f);
-    scale_matrix = scale(0.5f, 0.05f, 0.5f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+
+    //mirror
+    t = Transforms.add(mirror_eye, axis_angle(-90.0f, vec3(1.0f, 0.0f, 0.0f)), vec3(1.5f, 1.0f, 1.5f));
+    add_object(t, Frame, FrameDraw, White, 0, HiddenInMirror);
+    add_object(t, Mirror, TexDraw, MirrorTex, 0, HiddenInMirror);
+
+    //drink
+    t = Transforms.add(vec3(0.0f, 1.6f, 0.0f), ident, vec3(0.25f, 0.25f, 0.25f));
+    add_object(t, Mug, MatDraw, Glass, 0, Translucent);
+    t = Transforms.add(vec3(0.0f, 1.9f, 0.0f), ident, vec3(0.2f, 0.2f, 0.2f));
+    add_object(t, Cylinder, MatDraw, Liquid, 0, Translucent);
+}
+
+void update_scene( ) {
+    // Animated parts (unchanged values leave transforms clean)
+    GLfloat switch_angs[3] = {swtich1_ang, swtich2_ang, swtich3_ang};
+    for (int i = 0; i < 3; i++) {
+        Transforms.set_rotation(switchTransforms[i], axis_angle(switch_angs[i], vec3(0.0f, 0.0f, 1.0f)));
+    }
+    vec4 blinds_rot = axis_angle(blinds_ang, vec3(1.0f, 0.0f, 0.0f));
+    for (size_t i = 0; i < blindTransforms.size(); i++) {
+        Transforms.set_rotation(blindTransforms[i], blinds_rot);
+    }
+    Transforms.set_rotation(fanTransform, axis_angle(blade_ang, vec3(0.0f, 1.0f, 0.0f)));
+
+    // Rebuild world and normal matrices of changed transforms
+    Transforms.update(worker_pool);
+
+    // Refresh world bounds of moved objects on workers
+    parallel_for(worker_pool, SceneObjects.size(), [](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            SceneObject &o = SceneObjects[i];
+            if (Transforms.moved(o.transform)) {
+                const mat4 &m = Transforms.world(o.transform);
+                o.sphere = transform_sphere(m, boundingSphere[o.obj]);
+                transform_box(m, boundingBox[o.obj][0], boundingBox[o.obj][1], o.boxMin, o.boxMax);
+            }
+        }
+    });
+
+    // Refit hierarchy paths and GPU copies of moved objects
+    for (size_t i = 0; i < SceneObjects.size(); i++) {
+        const SceneObject &o = SceneObjects[i];
+        if (Transforms.moved(o.transform)) {
+            if (!sceneBvhStale) {
+                SceneBvh.update(i, o.boxMin, o.boxMax);
+            }
+            if (gpuCullSupported) {
+                upload_cull_object(i);
+            }
+        }
     }
-    draw_mat_object(Cylinder, StandingLight);
 
-    //fan blade
-    for (int i = 0; i < 2; i++) {
-        scale_matrix = scale(2.65f, 0.05f, 0.4f);
-        rot_matrix = rotate((90.0f * i) + blade_ang, 0.0f, 1.0f, 0.0f);
-        model_matrix = trans_matrix*rot_matrix*scale_matrix;
-        if (!shadow) {
-            // Set normal matrix for phong shadow shader
-            normal_matrix = model_matrix.inverse().transpose();
+    // Rebuild hierarchy once objects were added
+    if (sceneBvhStale) {
+        vector<vec3> lo(SceneObjects.size());
+        vector<vec3> hi(SceneObjects.size());
+        for (size_t i = 0; i < SceneObjects.size(); i++) {
+            lo[i] = SceneObjects[i].boxMin;
+            hi[i] = SceneObjects[i].boxMax;
         }
-        draw_mat_object(Cube, WoodLining);
+        SceneBvh.build(lo, hi);
+        sceneBvhStale = false;
     }
+}
 
-    //mirror
-    if (!mirror) {
-        draw_frame(Frame);
-        trans_matrix = translate(mirror_eye);
-        rot_matrix = rotate(-90.0f, vec3(1.0f, 0.0f, 0.0f));
-        scale_matrix = scale(1.5f, 1.0f, 1.5f);
-        model_matrix = trans_matrix*rot_matrix*scale_matrix;
-        draw_tex_object(Mirror, MirrorTex);
+// Camera box at pos overlaps any scene object
+bool camera_blocked(const vec3 &pos) {
+    vec3 r = vec3(CameraRadius, CameraRadius, CameraRadius);
+    vector<GLuint> hits;
+    lock_guard<mutex> lock(sceneMutex);
+    SceneBvh.query_box(pos - r, pos + r, hits);
+    return !hits.empty();
+}
+
+// Flip wall switch (fan, point light, spot light) in simulation state
+void toggle_switch(int sw) {
+    if (sw == 0) {
+        sim.spin = !sim.spin;
+        sim.switch_angs[0] = sim.spin ? 45.0f : -45.0f;
+    } else if (sw == 1) {
+        sim.lightOn[WhitePointLight] = !sim.lightOn[WhitePointLight];
+        sim.switch_angs[1] = sim.lightOn[WhitePointLight] ? 45.0f : -45.0f;
+    } else {
+        sim.lightOn[WhiteSpotLight] = !sim.lightOn[WhiteSpotLight];
+        sim.switch_angs[2] = sim.lightOn[WhiteSpotLight] ? 45.0f : -45.0f;
+    }
+}
+
+void print_cull_stats( ) {
+    for (int p = 0; p < NumPasses; p++) {
+        printf("%s pass: %u drawn, %u culled\n", passNames[p], drawnObjects[p], culledObjects[p]);
+    }
+    if (gpuCulling) {
+        GLuint batched = 0;
+        for (int i = 0; i < NumVAOs; i++) {
+            batched += batchDraws[i];
+        }
+        GLuint drawn = gpu_cull_drawn();
+        printf("main pass GPU batches: %u drawn, %u culled\n", drawn, batched - drawn);
+    }
+    if (dynamicRes) {
+        printf("main view %dx%d (scale %.2f of %dx%d)\n", rw, rh, render_scale(), ww, hh);
+    }
+    for (GLuint c = 0; c < NumStateCalls; c++) {
+        printf("%s: %u issued, %u filtered\n", state_call_name(c), frameState.issued[c], frameState.filtered[c]);
     }
+}
 
+void build_gpu_culling( ) {
+    gpuCullSupported = init_gpu_cull();
+    if (gpuCullSupported) {
+        ShaderInfo batch_shaders[] = { {GL_VERTEX_SHADER, phong_shadow_batch_vertex_shader},{GL_FRAGMENT_SHADER, phong_shadow_frag_shader},{GL_NONE, NULL} };
+        gpuCullSupported = load_program(phongShadowBatch_program, batch_shaders);
+    }
+    if (!gpuCullSupported) {
+        return;
+    }
+    bind_program_block(phongShadowBatch_program, "LightBuffer", 0);
+    bind_program_block(phongShadowBatch_program, "MaterialBuffer", 1);
 
-    //drink
-    trans_matrix = translate(0.0f, 1.6f, 0.0f);
-    scale_matrix = scale(0.25f, 0.25f, 0.25f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
-    }
-    glDepthMask(GL_FALSE);
-    draw_mat_object(Mug, Glass);
-    trans_matrix = translate(0.0f, 1.9f, 0.0f);
-    scale_matrix = scale(0.2f, 0.2f, 0.2f);
-    model_matrix = trans_matrix*scale_matrix;
-    if (!shadow) {
-        // Set normal matrix for phong shadow shader
-        normal_matrix = model_matrix.inverse().transpose();
+    // Opaque indexed material objects are batched by mesh
+    for (int i = 0; i < NumVAOs; i++) {
+        batchDraws[i] = 0;
+    }
+    for (size_t i = 0; i < SceneObjects.size(); i++) {
+        SceneObject &o = SceneObjects[i];
+        if (o.type == MatDraw && !(o.flags & Translucent) && numIndices[o.obj] > 0) {
+            o.batch = o.obj;
+            batchDraws[o.obj]++;
+        }
+    }
+    CullBatch batches[NumVAOs];
+    GLuint base = 0;
+    for (int i = 0; i < NumVAOs; i++) {
+        batches[i] = CullBatch();
+        for (GLint l = 0; l < numLods[i]; l++) {
+            batches[i].lodOffset[l] = lodOffset[i][l];
+            batches[i].lodCount[l] = lodCount[i][l];
+        }
+        batches[i].numLods = numLods[i];
+        batches[i].commandBase = base;
+        batches[i].maxDraws = batchDraws[i];
+        base += batchDraws[i];
     }
-    draw_mat_object(Cylinder, Liquid);
-    glDepthMask(GL_TRUE);
+    set_cull_batches(batches, NumVAOs);
+    for (size_t i = 0; i < SceneObjects.size(); i++) {
+        upload_cull_object(i);
+    }
+    gpuCulling = true;
 }
 
-void create_shadows( ){
-    shadow_proj_matrix = frustum(-1.0, 1.0, -1.0, 1.0, 1.0, 20.0);
+// Copy object bounds, transforms and material to GPU culling buffers
+void upload_cull_object(GLuint index) {
+    const SceneObject &o = SceneObjects[index];
+    CullObject cull = CullObject();
+    cull.sphere = o.sphere;
+    cull.batch = o.batch;
+    DrawObject draw = DrawObject();
+    draw.model_matrix = Transforms.world(o.transform);
+    draw.normal_matrix = Transforms.normal(o.transform);
+    draw.material = o.material;
+    set_cull_objects(&cull, &draw, index, 1);
+}
 
-    vec3 leye = {Lights[0].position[0], Lights[0].position[1], Lights[0].position[2]};
-    vec3 ldir = {Lights[0].direction[0], Lights[0].direction[1], Lights[0].direction[2]};
-    vec3 lup = {0.0f, 1.0f, 0.0f};
-    vec3 lcenter = leye + ldir;
-    shadow_camera_matrix = lookat(leye, lcenter, lup);
+void create_shadows( ){
+    shadow_proj_matrix = passViews[ShadowPass].proj;
+    shadow_camera_matrix = passViews[ShadowPass].camera;
 
     // Change viewport to match shadow framebuffer size
     glViewport(0, 0, 1024, 1024);
@@ -854,230 +1693,222 @@ void create_shadows( ){
     shadow = true;
     render_scene();
     shadow = false;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, ViewFramebuffer);
 
     // Reset viewport
-    glViewport(0, 0, ww, hh);
+    glViewport(0, 0, rw, rh);
 }
 
 void create_mirror( ) {
     // Clear framebuffer for mirror rendering pass
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    proj_matrix = frustum(-0.2f, 0.2f, -0.2f, 0.2f, 0.2f, 100.0f);
-
-    camera_matrix = lookat(mirror_eye, mirror_center, mirror_up);
+    proj_matrix = passViews[MirrorPass].proj;
+    camera_matrix = passViews[MirrorPass].camera;
 
     // Render mirror scene (without mirror)
     mirror = true;
     render_scene();
-    glFlush();
     mirror = false;
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, TextureIDs[MirrorTex]);
-    glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 0, 0, ww, hh, 0);
+    // Copy into existing storage (reallocated only after resize or scale change)
+    state_active_texture(GL_TEXTURE0);
+    state_bind_texture(GL_TEXTURE_2D, TextureIDs[MirrorTex]);
+    if (rw != mirrorWidth || rh != mirrorHeight) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rw, rh, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        mirrorWidth = rw;
+        mirrorHeight = rh;
+    }
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, rw, rh);
 }
 
 void draw_bump_object(GLuint obj, GLuint base_texture, GLuint normal_map){
-    // Select shader program
-    glUseProgram(bump_program);
+    // Select shader program (derivative tangent frames if material asks or object has no tangents)
+    ShaderProgram &prog = (TangentFrame[normal_map] == DerivFrame || !hasTangents[obj]) ? bumpDeriv_program : bump_program;
+    state_use_program(prog.id);
 
     // Pass projection and camera matrices to shader
-    glUniformMatrix4fv(bump_proj_mat_loc, 1, GL_FALSE, proj_matrix);
-    glUniformMatrix4fv(bump_camera_mat_loc, 1, GL_FALSE, camera_matrix);
+    set_uniform(prog, UniProjMatrix, proj_matrix);
+    set_uniform(prog, UniCameraMatrix, camera_matrix);
 
     // Bind lights
-    glUniformBlockBinding(bump_program, bump_lights_block_idx, 0);
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, LightBuffers[LightBuffer], 0, Lights.size() * sizeof(LightProperties));
+    state_bind_buffer_range(GL_UNIFORM_BUFFER, 0, LightBuffers[LightBuffer], 0, Lights.size() * sizeof(LightProperties));
 
     // Set camera position
-    glUniform3fv(bump_eye_loc, 1, eye);
+    set_uniform(prog, UniEyePosition, eye);
 
     // Set num lights and lightOn
-    glUniform1i(bump_num_lights_loc, numLights);
-    glUniform1iv(bump_light_on_loc, numLights, lightOn);
+    set_uniform(prog, UniNumLights, numLights);
+    set_uniform(prog, UniLightOn, lightOn, numLights);
 
     // Pass model matrix and normal matrix to shader
-    glUniformMatrix4fv(bump_model_mat_loc, 1, GL_FALSE, model_matrix);
-    glUniformMatrix4fv(bump_norm_mat_loc, 1, GL_FALSE, normal_matrix);
+    set_uniform(prog, UniModelMatrix, model_matrix);
+    set_uniform(prog, UniNormalMatrix, normal_matrix);
 
     // Set base texture to texture unit 0 and make it active
-    glUniform1i(bump_base_loc, 0);
-    glActiveTexture(GL_TEXTURE0);
+    set_uniform(prog, UniBaseMap, 0);
+    state_active_texture(GL_TEXTURE0);
     // Bind base texture (to unit 0)
-    glBindTexture(GL_TEXTURE_2D, TextureIDs[base_texture]);
+    bind_texture(base_texture);
 
     // Set normal map texture to texture unit 1 and make it active
-    glUniform1i(bump_norm_loc, 1);
-    glActiveTexture(GL_TEXTURE1);
+    set_uniform(prog, UniNormalMap, 1);
+    state_active_texture(GL_TEXTURE1);
     // Bind normal map texture (to unit 1)
-    glBindTexture(GL_TEXTURE_2D, TextureIDs[normal_map]);
+    bind_texture(normal_map);
 
     // Bind vertex array
-    glBindVertexArray(VAOs[obj]);
+    state_bind_vertex_array(VAOs[obj]);
 
     // Bind position object buffer and set attributes
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
-    glVertexAttribPointer(bump_vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(bump_vPos);
+    GLint vPos = program_attrib(prog, AttrPosition);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
+    glVertexAttribPointer(vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(vPos);
 
     // Bind normal object buffer and set attributes
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
-    glVertexAttribPointer(bump_vNorm, normCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(bump_vNorm);
+    GLint vNorm = program_attrib(prog, AttrNormal);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
+    glVertexAttribPointer(vNorm, normCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(vNorm);
 
     // Bind texture object buffer and set attributes
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TexBuffer]);
-    glVertexAttribPointer(bump_vTex, texCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(bump_vTex);
-
-    // Bind tangent object buffer and set attributes
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TangBuffer]);
-    glVertexAttribPointer(bump_vTang, tangCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(bump_vTang);
-
-    // Bind bitangent object buffer and set attributes
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][BiTangBuffer]);
-    glVertexAttribPointer(bump_vBiTang, bitangCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(bump_vBiTang);
+    GLint vTex = program_attrib(prog, AttrTexCoord);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TexBuffer]);
+    glVertexAttribPointer(vTex, texCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(vTex);
+
+    // Bind tangent object buffer and set attributes (vertex tangent frames only)
+    GLint vTang = program_attrib(prog, AttrTangent);
+    if (vTang >= 0) {
+        state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TangBuffer]);
+        glVertexAttribPointer(vTang, tangCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(vTang);
+    }
 
     // Draw object
-    glDrawArrays(GL_TRIANGLES, 0, numVertices[obj]);
+    draw_triangles(obj);
 }
 
 void draw_bump_shadow_object(GLuint obj, GLuint base_texture, GLuint normal_map){
+    ShaderProgram *prog;
     if (shadow) {
         // Use shadow shader
-        glUseProgram(shadow_program);
+        prog = &shadow_program;
+        state_use_program(prog->id);
         // Pass shadow projection and camera matrices to shader
-        glUniformMatrix4fv(shadow_proj_mat_loc, 1, GL_FALSE, shadow_proj_matrix);
-        glUniformMatrix4fv(shadow_camera_mat_loc, 1, GL_FALSE, shadow_camera_matrix);
-
-        // Set object attributes to shadow shader
-        vPos = shadow_vPos;
-        model_mat_loc = shadow_model_mat_loc;
+        set_uniform(*prog, UniLightProjMatrix, shadow_proj_matrix);
+        set_uniform(*prog, UniLightCamMatrix, shadow_camera_matrix);
     } else {
-        // Select shader program
-        glUseProgram(bumpShadow_program);
+        // Use bump shadow shader
+        prog = &bumpShadow_program;
+        state_use_program(prog->id);
 
         // Pass projection and camera matrices to shader
-        glUniformMatrix4fv(bumpShadow_proj_mat_loc, 1, GL_FALSE, proj_matrix);
-        glUniformMatrix4fv(bumpShadow_camera_mat_loc, 1, GL_FALSE, camera_matrix);
+        set_uniform(*prog, UniProjMatrix, proj_matrix);
+        set_uniform(*prog, UniCameraMatrix, camera_matrix);
 
         // Bind lights
-        glUniformBlockBinding(bumpShadow_program, bump_lights_block_idx, 0);
-        glBindBufferRange(GL_UNIFORM_BUFFER, 0, LightBuffers[LightBuffer], 0, Lights.size() * sizeof(LightProperties));
+        state_bind_buffer_range(GL_UNIFORM_BUFFER, 0, LightBuffers[LightBuffer], 0, Lights.size() * sizeof(LightProperties));
 
         // Set camera position
-        glUniform3fv(bumpShadow_eye_loc, 1, eye);
+        set_uniform(*prog, UniEyePosition, eye);
 
         // Set num lights and lightOn
-        glUniform1i(bumpShadow_num_lights_loc, numLights);
-        glUniform1iv(bumpShadow_light_on_loc, numLights, lightOn);
+        set_uniform(*prog, UniNumLights, numLights);
+        set_uniform(*prog, UniLightOn, lightOn, numLights);
 
-        // Pass model matrix and normal matrix to shader
-        glUniformMatrix4fv(bumpShadow_norm_mat_loc, 1, GL_FALSE, normal_matrix);
+        // Pass normal matrix to shader
+        set_uniform(*prog, UniNormalMatrix, normal_matrix);
 
         // Set base texture to texture unit 0 and make it active
-        glUniform1i(bumpShadow_base_loc, 0);
-        glActiveTexture(GL_TEXTURE0);
+        set_uniform(*prog, UniBaseMap, 0);
+        state_active_texture(GL_TEXTURE0);
         // Bind base texture (to unit 0)
-        glBindTexture(GL_TEXTURE_2D, TextureIDs[base_texture]);
+        bind_texture(base_texture);
 
         // Set normal map texture to texture unit 1 and make it active
-        glUniform1i(bumpShadow_norm_loc, 1);
-        glActiveTexture(GL_TEXTURE1);
+        set_uniform(*prog, UniNormalMap, 1);
+        state_active_texture(GL_TEXTURE1);
         // Bind normal map texture (to unit 1)
-        glBindTexture(GL_TEXTURE_2D, TextureIDs[normal_map]);
-
-        glUniform1i(bumpShadow_shadow_loc, 2);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, TextureIDs[ShadowTex]);
+        bind_texture(normal_map);
 
-        glUniformMatrix4fv(bumpShadow_shad_proj_mat_loc, 1, GL_FALSE, shadow_proj_matrix);
-        glUniformMatrix4fv(bumpShadow_shad_cam_mat_loc, 1, GL_FALSE, shadow_camera_matrix);
+        // Set shadow map texture to texture unit 2 and make it active
+        set_uniform(*prog, UniShadowMap, 2);
+        state_active_texture(GL_TEXTURE2);
+        state_bind_texture(GL_TEXTURE_2D, TextureIDs[ShadowTex]);
 
-        // Set object attributes for phong shadow shader
-        vPos = bumpShadow_vPos;
-        model_mat_loc = bumpShadow_model_mat_loc;
+        set_uniform(*prog, UniLightProjMatrix, shadow_proj_matrix);
+        set_uniform(*prog, UniLightCamMatrix, shadow_camera_matrix);
     }
 
-    glUniformMatrix4fv(model_mat_loc, 1, GL_FALSE, model_matrix);
+    set_uniform(*prog, UniModelMatrix, model_matrix);
 
     // Bind vertex array
-    glBindVertexArray(VAOs[obj]);
+    state_bind_vertex_array(VAOs[obj]);
 
     // Bind position object buffer and set attributes
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
+    GLint vPos = program_attrib(*prog, AttrPosition);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
     glVertexAttribPointer(vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
     glEnableVertexAttribArray(vPos);
 
     if (!shadow) {
         // Bind normal object buffer and set attributes
-        glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
-        glVertexAttribPointer(bumpShadow_vNorm, normCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(bumpShadow_vNorm);
+        GLint vNorm = program_attrib(*prog, AttrNormal);
+        state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
+        glVertexAttribPointer(vNorm, normCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(vNorm);
 
         // Bind texture object buffer and set attributes
-        glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TexBuffer]);
-        glVertexAttribPointer(bumpShadow_vTex, texCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(bumpShadow_vTex);
+        GLint vTex = program_attrib(*prog, AttrTexCoord);
+        state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TexBuffer]);
+        glVertexAttribPointer(vTex, texCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(vTex);
 
         // Bind tangent object buffer and set attributes
-        glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TangBuffer]);
-        glVertexAttribPointer(bumpShadow_vTang, tangCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(bumpShadow_vTang);
-
-        // Bind bitangent object buffer and set attributes
-        glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][BiTangBuffer]);
-        glVertexAttribPointer(bumpShadow_vBiTang, bitangCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(bumpShadow_vBiTang);
+        GLint vTang = program_attrib(*prog, AttrTangent);
+        state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TangBuffer]);
+        glVertexAttribPointer(vTang, tangCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(vTang);
     }
 
     // Draw object
-    glDrawArrays(GL_TRIANGLES, 0, numVertices[obj]);
+    draw_triangles(obj);
 }
 
 void draw_frame(GLuint obj){
     // Draw frame using lines at mirror location
-    glUseProgram(lighting_program);
+    state_use_program(lighting_program.id);
     // Pass projection and camera matrices to shader
-    glUniformMatrix4fv(lighting_proj_mat_loc, 1, GL_FALSE, proj_matrix);
-    glUniformMatrix4fv(lighting_camera_mat_loc, 1, GL_FALSE, camera_matrix);
+    set_uniform(lighting_program, UniProjMatrix, proj_matrix);
+    set_uniform(lighting_program, UniCameraMatrix, camera_matrix);
 
     // Bind lights
-    glUniformBlockBinding(lighting_program, lighting_lights_block_idx, 0);
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, LightBuffers[LightBuffer], 0, Lights.size()*sizeof(LightProperties));
+    state_bind_buffer_range(GL_UNIFORM_BUFFER, 0, LightBuffers[LightBuffer], 0, Lights.size()*sizeof(LightProperties));
     // Bind materials
-    glUniformBlockBinding(lighting_program, lighting_materials_block_idx, 1);
-    glBindBufferRange(GL_UNIFORM_BUFFER, 1, MaterialBuffers[MaterialBuffer], 0, Materials.size()*sizeof(MaterialProperties));
+    state_bind_buffer_range(GL_UNIFORM_BUFFER, 1, MaterialBuffers[MaterialBuffer], 0, Materials.size()*sizeof(MaterialProperties));
     // Set camera position
-    glUniform3fv(lighting_eye_loc, 1, eye);
+    set_uniform(lighting_program, UniEyePosition, eye);
     // Set num lights and lightOn
-    glUniform1i(lighting_num_lights_loc, numLights);
-    glUniform1iv(lighting_light_on_loc, numLights, lightOn);
-
-    // Set frame transformation matrix
-    mat4 trans_matrix = translate(mirror_eye);
-    mat4 rot_matrix = rotate(-90.0f, vec3(1.0f, 0.0f, 0.0f));
-    mat4 scale_matrix = scale(1.5f, 1.0f, 1.5f);
-    model_matrix = trans_matrix * rot_matrix * scale_matrix;
-    // Compute normal matrix from model matrix
-    normal_matrix = model_matrix.inverse().transpose();
+    set_uniform(lighting_program, UniNumLights, numLights);
+    set_uniform(lighting_program, UniLightOn, lightOn, numLights);
+
     // Pass model matrix and normal matrix to shader
-    glUniformMatrix4fv(lighting_model_mat_loc, 1, GL_FALSE, model_matrix);
-    glUniformMatrix4fv(lighting_norm_mat_loc, 1, GL_FALSE, normal_matrix);
-    glUniform1i(lighting_material_loc, White);
+    set_uniform(lighting_program, UniModelMatrix, model_matrix);
+    set_uniform(lighting_program, UniNormalMatrix, normal_matrix);
+    set_uniform(lighting_program, UniMaterial, White);
 
     // Draw object using line loop
-    glBindVertexArray(VAOs[obj]);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
-    glVertexAttribPointer(lighting_vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(lighting_vPos);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
-    glVertexAttribPointer(lighting_vNorm, normCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(lighting_vNorm);
+    GLint vPos = program_attrib(lighting_program, AttrPosition);
+    GLint vNorm = program_attrib(lighting_program, AttrNormal);
+    state_bind_vertex_array(VAOs[obj]);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
+    glVertexAttribPointer(vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(vPos);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
+    glVertexAttribPointer(vNorm, normCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(vNorm);
     glDrawArrays(GL_LINE_LOOP, 0, numVertices[obj]);
 
 }
@@ -1087,6 +1918,14 @@ void build_geometry( )
     // Generate vertex arrays and buffers
     glGenVertexArrays(NumVAOs, VAOs);
 
+    // Only objects bump mapped with a vertex tangent frame material need tangents
+    for (size_t i = 0; i < SceneObjects.size(); i++) {
+        const SceneObject &o = SceneObjects[i];
+        if (o.type == BumpDraw && TangentFrame[o.normal_map] == VertexFrame) {
+            hasTangents[o.obj] = true;
+        }
+    }
+
     // Load models
     load_model(cubeFile, Cube);
     load_model(cylinderFile, Cylinder);
@@ -1174,7 +2013,7 @@ void build_materials( ) {
     Materials.push_back(tin);
 
     glGenBuffers(NumMaterialBuffers, MaterialBuffers);
-    glBindBuffer(GL_UNIFORM_BUFFER, MaterialBuffers[MaterialBuffer]);
+    state_bind_buffer(GL_UNIFORM_BUFFER, MaterialBuffers[MaterialBuffer]);
     glBufferData(GL_UNIFORM_BUFFER, Materials.size()*sizeof(MaterialProperties), Materials.data(), GL_STATIC_DRAW);
 }
 
@@ -1183,8 +2022,7 @@ void build_texture_cube(GLuint obj) {
     vector<vec3> normals;
     vector<vec2> uvCoords;
     vector<ivec3> indices;
-    vector<vec3> tangents;
-    vector<vec3> bitangents;
+    vector<vec4> tangents;
 
     // Define 3D vertices for cube
     vertices = {
@@ -1323,22 +2161,27 @@ void build_texture_cube(GLuint obj) {
     // Set number of vertices
     numVertices[obj] = vertices.size();
 
-    computeTangentBasis(vertices, uvCoords, normals, tangents, bitangents);
+    compute_bounds(vertices, obj);
+
+    // Same tangent generator as imported meshes (unindexed triangle list)
+    if (hasTangents[obj]) {
+        generate_tangents(vertices, normals, uvCoords, vector<GLuint>(), tangents, worker_pool);
+    }
 
     // Create and load object buffers
     glGenBuffers(NumObjBuffers, ObjBuffers[obj]);
-    glBindVertexArray(VAOs[obj]);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
+    state_bind_vertex_array(VAOs[obj]);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*posCoords*numVertices[obj], vertices.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*normCoords*numVertices[obj], normals.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TexBuffer]);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TexBuffer]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*texCoords*numVertices[obj], uvCoords.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TangBuffer]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*tangCoords*numVertices[obj], tangents.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][BiTangBuffer]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*bitangCoords*numVertices[obj], bitangents.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (hasTangents[obj]) {
+        state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TangBuffer]);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*tangCoords*numVertices[obj], tangents.data(), GL_STATIC_DRAW);
+    }
+    state_bind_buffer(GL_ARRAY_BUFFER, 0);
 }
 
 void build_lights( ) {
@@ -1381,7 +2224,7 @@ void build_lights( ) {
 
     // Create uniform buffer for lights
     glGenBuffers(NumLightBuffers, LightBuffers);
-    glBindBuffer(GL_UNIFORM_BUFFER, LightBuffers[LightBuffer]);
+    state_bind_buffer(GL_UNIFORM_BUFFER, LightBuffers[LightBuffer]);
     glBufferData(GL_UNIFORM_BUFFER, Lights.size()*sizeof(LightProperties), Lights.data(), GL_STATIC_DRAW);
 }
 
@@ -1389,9 +2232,11 @@ void build_mirror(GLuint m_texid ) {
     // Generate mirror texture
     glGenTextures(1, &TextureIDs[m_texid]);
     // Bind mirror texture
-    glBindTexture(GL_TEXTURE_2D, TextureIDs[m_texid]);
+    state_bind_texture(GL_TEXTURE_2D, TextureIDs[m_texid]);
 
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ww, hh, 0, GL_RGBA, GL_FLOAT, NULL);
+    mirrorWidth = ww;
+    mirrorHeight = hh;
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -1418,15 +2263,16 @@ void build_frame(GLuint obj) {
     };
 
     numVertices[obj] = vertices.size();
+    compute_bounds(vertices, obj);
 
     // Create and load object buffers
     glGenBuffers(NumObjBuffers, ObjBuffers[obj]);
-    glBindVertexArray(VAOs[obj]);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
+    state_bind_vertex_array(VAOs[obj]);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*posCoords*numVertices[obj], vertices.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*normCoords*numVertices[obj], normals.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    state_bind_buffer(GL_ARRAY_BUFFER, 0);
 }
 
 void build_shadows( ) {
@@ -1434,7 +2280,7 @@ void build_shadows( ) {
     glGenFramebuffers(1, &ShadowBuffer);
     glGenTextures(1, &TextureIDs[ShadowTex]);
     // Bind shadow texture and only store depth value
-    glBindTexture(GL_TEXTURE_2D, TextureIDs[ShadowTex]);
+    state_bind_texture(GL_TEXTURE_2D, TextureIDs[ShadowTex]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 1024, 1024, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -1445,25 +2291,46 @@ void build_shadows( ) {
     // Buffer is not actually drawn into since only for creating shadow texture
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, MainFramebuffer);
 }
 
 void build_textures( ) {
 
     // Create textures and activate unit 0
     glGenTextures( NumTextures,  TextureIDs);
-    glActiveTexture( GL_TEXTURE0 );
-
-    load_texture(blankFile, Blank, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false);
-    load_texture(woodFile, Wood, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false);
-    load_texture(carpetFile, Carpet, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false);
-    load_texture(roofFile, Roof, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false);
-    load_texture(doorFile, Door, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false);
-    load_texture(windowFile, Widow, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false);
-    load_texture(carpetNormFile, CarpetNorm, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false);
-    load_texture(roofNormFile, RoofNorm, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false);
-    load_texture(doorNormFile, DoorNorm, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false);
-    load_texture(woodNormFile, WoodNorm, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false);
+    state_active_texture( GL_TEXTURE0 );
+
+    // Register textures (cooked .ctex or decoded source) to stream in when first drawn
+    TextureRequest requests[] = {
+            {blankFile, Blank, AlbedoMap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false},
+            {woodFile, Wood, AlbedoMap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false},
+            {carpetFile, Carpet, AlbedoMap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false},
+            {roofFile, Roof, AlbedoMap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false},
+            {doorFile, Door, AlbedoMap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false},
+            {windowFile, Widow, AlbedoMap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false},
+            {carpetNormFile, CarpetNorm, NormalMap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false},
+            {roofNormFile, RoofNorm, NormalMap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false},
+            {doorNormFile, DoorNorm, NormalMap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false},
+            {woodNormFile, WoodNorm, NormalMap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT, true, false}
+    };
+    register_textures(requests, sizeof(requests)/sizeof(requests[0]));
+    // Tangent frame per normal map (derivative frames suit planar faces and need no tangent stream)
+    TangentFrame[CarpetNorm] = VertexFrame;
+    TangentFrame[RoofNorm] = VertexFrame;
+    TangentFrame[DoorNorm] = DerivFrame;
+    TangentFrame[WoodNorm] = DerivFrame;
+
+    // Blank is bound in place of textures still loading so it is needed up front
+    load_texture(Blank);
+
+    // Flat normal (RG = 0.5) stands in for normal maps still loading
+    const GLubyte flat[2] = {128, 128};
+    state_bind_texture(GL_TEXTURE_2D, TextureIDs[FlatNorm]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, 1, 1, 0, GL_RG, GL_UNSIGNED_BYTE, flat);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 }
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
@@ -1474,66 +2341,85 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 
     // Adjust azimuth
     if (key == GLFW_KEY_A) {
-        camera_angle -= 0.1f;
+        submit_input(TurnInput, -0.1f);
     } else if (key == GLFW_KEY_D) {
-        camera_angle += 0.1f;
+        submit_input(TurnInput, 0.1f);
     }
 
     // Adjust elevation angle
+    // Move camera unless it would run into an object (log keeps resulting position)
+    dir = vec3(cos(sim.camera_angle), 0.0f, sin(sim.camera_angle));
+    vec3 pos = sim.eye;
     if (key == GLFW_KEY_W)
     {
-        dir = center - eye;
-        eye = eye + (dir * stepSize);
+        pos = sim.eye + (dir * stepSize);
     }
     else if (key == GLFW_KEY_S)
     {
-        dir = center - eye;
-        eye = eye - (dir * stepSize);
+        pos = sim.eye - (dir * stepSize);
+    }
+    if ((key == GLFW_KEY_W || key == GLFW_KEY_S) && !camera_blocked(pos)) {
+        submit_input(MoveInput, pos[0], pos[1], pos[2]);
     }
 
     //light controls
     if (key == GLFW_KEY_1 && action == GLFW_PRESS) {
-        if (lightOn[WhitePointLight] == 1) {
-            lightOn[WhitePointLight] = 0;
-            swtich2_ang = -45.0f;
-        }else {
-            lightOn[WhitePointLight] = 1;
-            swtich2_ang = 45.0f;
-        }
+        submit_input(SwitchInput, 1);
     }
     if (key == GLFW_KEY_2 && action == GLFW_PRESS) {
-        if (lightOn[WhiteSpotLight] == 1) {
-            lightOn[WhiteSpotLight] = 0;
-            swtich3_ang = -45.0f;
-        }else {
-            lightOn[WhiteSpotLight] = 1;
-            swtich3_ang = 45.0f;
-        }
+        submit_input(SwitchInput, 2);
     }
 
     //fan control
     if (key == GLFW_KEY_F && action == GLFW_PRESS) {
-        if (spin) {
-            spin = false;
-            swtich1_ang = -45.0f;
-        }else {
-            spin = true;
-            swtich1_ang = 45.0f;
-        }
+        submit_input(SwitchInput, 0);
     }
 
     //blinds control
     if (key == GLFW_KEY_B && action == GLFW_PRESS) {
-        if (blinds) {
-            blinds = false;
-        }else {
-            blinds = true;
-        }
+        submit_input(BlindsInput);
+    }
+
+    //culling statistics
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        submit_input(StatsInput);
+    }
+
+    //switch between GPU and CPU culling
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        submit_input(CullingInput);
     }
 }
 
 void mouse_callback(GLFWwindow *window, int button, int action, int mods){
-
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS || replaying) {
+        return;
+    }
+    // Unproject cursor to world space ray between near and far planes
+    double x, y;
+    int w, h;
+    glfwGetCursorPos(window, &x, &y);
+    glfwGetWindowSize(window, &w, &h);
+    GLfloat nx = 2.0f*(GLfloat)x/w - 1.0f;
+    GLfloat ny = 1.0f - 2.0f*(GLfloat)y/h;
+    // Main view and hierarchy are shared with render thread
+    lock_guard<mutex> lock(sceneMutex);
+    mat4 inv = (passViews[MainPass].proj*passViews[MainPass].camera).inverse();
+    vec4 p0 = inv*vec4(nx, ny, -1.0f, 1.0f);
+    vec4 p1 = inv*vec4(nx, ny, 1.0f, 1.0f);
+    vec3 origin = vec3(p0[0], p0[1], p0[2])/p0[3];
+    vec3 target = vec3(p1[0], p1[1], p1[2])/p1[3];
+
+    // Clicking a wall switch flips it (log keeps switch hit, not cursor)
+    GLuint item;
+    GLfloat t;
+    if (SceneBvh.ray_cast(origin, target - origin, 1.0f, item, t)) {
+        for (int i = 0; i < 3; i++) {
+            if (SceneObjects[item].transform == switchTransforms[i]) {
+                submit_input(SwitchInput, i);
+            }
+        }
+    }
 }
 
 // Debug shadow renderer
@@ -1547,9 +2433,9 @@ void renderQuad()
 
     // render Depth map to quad for visual debugging
     // ---------------------------------------------
-    glUseProgram(debug_program);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, TextureIDs[ShadowTex]);
+    state_use_program(debug_program.id);
+    state_active_texture(GL_TEXTURE0);
+    state_bind_texture(GL_TEXTURE_2D, TextureIDs[ShadowTex]);
     if (quadVAO == 0)
     {
         float quadVertices[] = {
@@ -1562,17 +2448,17 @@ void renderQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        state_bind_vertex_array(quadVAO);
+        state_bind_buffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    state_bind_vertex_array(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
+    state_bind_vertex_array(0);
 }
 
 #include "utilfuncs.cpp"
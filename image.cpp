@@ -0,0 +1,183 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <stdio.h>
+#include <string.h>
+#include "../common/stb_image.h"
+#include "image.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define IMAGE_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+bool decode_image(const char *filename, Image &image, GLint channels, bool invert, bool mipMap) {
+    int w, h, n;
+
+    static const GLenum formats[] = {GL_NONE, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+
+    image.channels = channels;
+    image.format = formats[channels];
+    image.levels.clear();
+
+    // R and RG are taken from red/green of RGBA (stb would convert to luminance/alpha)
+    GLint load_channels = channels >= 3 ? channels : 4;
+    unsigned char *image_data = stbi_load(filename, &w, &h, &n, load_channels);
+    if (!image_data) {
+        fprintf(stderr, "ERROR: could not load %s\n", filename);
+        return false;
+    }
+    // NPOT check for power of 2 dimensions
+    if ((w & (w - 1)) != 0 || (h & (h - 1)) != 0) {
+        fprintf(stderr, "WARNING: texture %s is not power-of-2 dimensions\n", filename);
+    }
+
+    ImageLevel base;
+    base.width = w;
+    base.height = h;
+    if (load_channels == channels) {
+        base.pixels.assign(image_data, image_data + (size_t)w*h*channels);
+    } else {
+        base.pixels.resize((size_t)w*h*channels);
+        convert_rgba(image_data, base.pixels.data(), (size_t)w*h, channels);
+    }
+    stbi_image_free(image_data);
+    image.levels.push_back(base);
+
+    // Invert image (e.g. jpeg, png)
+    if (invert) {
+        flip_image_rows(image.levels[0].pixels.data(), w, h, channels);
+    }
+
+    if (mipMap) {
+        build_mip_chain(image);
+    }
+    return true;
+}
+
+GLint albedo_channels(const char *filename) {
+    int w, h, n;
+    if (!stbi_info(filename, &w, &h, &n)) {
+        return 4;
+    }
+    // Grey+alpha and RGBA keep alpha, everything else is opaque RGB
+    return (n == 2 || n == 4) ? 4 : 3;
+}
+
+// Swap two rows of bytes
+static void swap_rows(GLubyte *a, GLubyte *b, size_t bytes) {
+    size_t i = 0;
+#if defined(IMAGE_SSE2)
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        _mm_storeu_si128((__m128i *)(a + i), vb);
+        _mm_storeu_si128((__m128i *)(b + i), va);
+    }
+#elif defined(IMAGE_NEON)
+    for (; i + 16 <= bytes; i += 16) {
+        uint8x16_t va = vld1q_u8(a + i);
+        uint8x16_t vb = vld1q_u8(b + i);
+        vst1q_u8(a + i, vb);
+        vst1q_u8(b + i, va);
+    }
+#endif
+    // Scalar tail (whole row without SIMD)
+    for (; i < bytes; i++) {
+        GLubyte temp = a[i];
+        a[i] = b[i];
+        b[i] = temp;
+    }
+}
+
+void flip_image_rows(GLubyte *pixels, GLsizei width, GLsizei height, GLint channels) {
+    size_t width_in_bytes = (size_t)width*channels;
+    GLsizei half_height = height / 2;
+
+    for (GLsizei row = 0; row < half_height; row++) {
+        GLubyte *top = pixels + row*width_in_bytes;
+        GLubyte *bottom = pixels + (height - row - 1)*width_in_bytes;
+        swap_rows(top, bottom, width_in_bytes);
+    }
+}
+
+void convert_rgba(const GLubyte *src, GLubyte *dst, size_t pixels, GLint channels) {
+    size_t i = 0;
+#if defined(IMAGE_SSE2)
+    if (channels == 1) {
+        // 16 pixels: keep low byte of each 32 bit pixel then pack 32 -> 16 -> 8 bits
+        const __m128i mask = _mm_set1_epi32(0xff);
+        for (; i + 16 <= pixels; i += 16) {
+            __m128i p0 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + 4*i)), mask);
+            __m128i p1 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + 4*i + 16)), mask);
+            __m128i p2 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + 4*i + 32)), mask);
+            __m128i p3 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + 4*i + 48)), mask);
+            __m128i lo = _mm_packs_epi32(p0, p1);
+            __m128i hi = _mm_packs_epi32(p2, p3);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+        }
+    } else if (channels == 2) {
+        // 8 pixels: sign extend low 16 bits (RG) so signed pack keeps them exactly
+        for (; i + 8 <= pixels; i += 8) {
+            __m128i p0 = _mm_loadu_si128((const __m128i *)(src + 4*i));
+            __m128i p1 = _mm_loadu_si128((const __m128i *)(src + 4*i + 16));
+            p0 = _mm_srai_epi32(_mm_slli_epi32(p0, 16), 16);
+            p1 = _mm_srai_epi32(_mm_slli_epi32(p1, 16), 16);
+            _mm_storeu_si128((__m128i *)(dst + 2*i), _mm_packs_epi32(p0, p1));
+        }
+    }
+#elif defined(IMAGE_NEON)
+    // De-interleave 16 pixels and store wanted channels interleaved again
+    for (; (channels == 1 || channels == 2) && i + 16 <= pixels; i += 16) {
+        uint8x16x4_t p = vld4q_u8(src + 4*i);
+        if (channels == 1) {
+            vst1q_u8(dst + i, p.val[0]);
+        } else {
+            uint8x16x2_t rg = {{p.val[0], p.val[1]}};
+            vst2q_u8(dst + 2*i, rg);
+        }
+    }
+#endif
+    // Scalar tail (whole image without SIMD)
+    for (; i < pixels; i++) {
+        for (GLint k = 0; k < channels; k++) {
+            dst[channels*i + k] = src[4*i + k];
+        }
+    }
+}
+
+void build_mip_chain(Image &image) {
+    GLint c = image.channels;
+
+    while (image.levels.back().width > 1 || image.levels.back().height > 1) {
+        const ImageLevel &src = image.levels.back();
+        ImageLevel dst;
+        dst.width = src.width > 1 ? src.width / 2 : 1;
+        dst.height = src.height > 1 ? src.height / 2 : 1;
+        dst.pixels.resize((size_t)dst.width*dst.height*c);
+
+        // Average 2x2 block (clamped at edges of odd or 1 pixel wide levels)
+        for (GLsizei y = 0; y < dst.height; y++) {
+            GLsizei y0 = 2*y < src.height ? 2*y : src.height - 1;
+            GLsizei y1 = 2*y + 1 < src.height ? 2*y + 1 : src.height - 1;
+            for (GLsizei x = 0; x < dst.width; x++) {
+                GLsizei x0 = 2*x < src.width ? 2*x : src.width - 1;
+                GLsizei x1 = 2*x + 1 < src.width ? 2*x + 1 : src.width - 1;
+                const GLubyte *p00 = &src.pixels[((size_t)y0*src.width + x0)*c];
+                const GLubyte *p01 = &src.pixels[((size_t)y0*src.width + x1)*c];
+                const GLubyte *p10 = &src.pixels[((size_t)y1*src.width + x0)*c];
+                const GLubyte *p11 = &src.pixels[((size_t)y1*src.width + x1)*c];
+                GLubyte *out = &dst.pixels[((size_t)y*dst.width + x)*c];
+                for (GLint k = 0; k < c; k++) {
+                    out[k] = (GLubyte)((p00[k] + p01[k] + p10[k] + p11[k] + 2) / 4);
+                }
+            }
+        }
+        image.levels.push_back(dst);
+    }
+}
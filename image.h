@@ -0,0 +1,41 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <vector>
+#include "../common/vgl.h"
+
+// Single mip level of decoded image
+struct ImageLevel {
+    GLsizei width;
+    GLsizei height;
+    std::vector<GLubyte> pixels;
+};
+
+// Decoded image with optional CPU generated mip chain
+struct Image {
+    GLint channels;
+    GLenum format;      // GL internal format of level data
+    std::vector<ImageLevel> levels;
+};
+
+// Decode image file to 1 (R8), 2 (RG8), 3 (RGB8) or 4 (RGBA8) channels
+// (safe to call from worker threads)
+bool decode_image(const char *filename, Image &image, GLint channels, bool invert, bool mipMap);
+
+// Channel count for color texture (3 unless source has alpha)
+GLint albedo_channels(const char *filename);
+
+// Flip image rows in place (SIMD with scalar fallback)
+void flip_image_rows(GLubyte *pixels, GLsizei width, GLsizei height, GLint channels);
+
+// Extract first 1 or 2 channels of RGBA pixels (SIMD with scalar fallback, which also handles 3)
+void convert_rgba(const GLubyte *src, GLubyte *dst, size_t pixels, GLint channels);
+
+// Append box filtered mip levels down to 1x1
+void build_mip_chain(Image &image);
+
+#endif
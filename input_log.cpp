@@ -0,0 +1,84 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <stdio.h>
+#include <string.h>
+#include "input_log.h"
+
+using namespace std;
+
+static const char *InputNames[NumInputTypes] = {"turn", "move", "switch", "blinds", "culling", "stats", "end"};
+
+// Log format version written in first line
+static const char *InputLogHeader = "house-input 1";
+
+static FILE *recordFile = NULL;
+
+bool start_input_record(const char *filename) {
+    recordFile = fopen(filename, "w");
+    if (!recordFile) {
+        fprintf(stderr, "ERROR: could not create input log %s\n", filename);
+        return false;
+    }
+    fprintf(recordFile, "%s\n", InputLogHeader);
+    return true;
+}
+
+void record_input(const InputEvent &event) {
+    if (!recordFile) {
+        return;
+    }
+    // Nine significant digits round trip floats exactly
+    fprintf(recordFile, "%llu %s %.9g %.9g %.9g\n", (unsigned long long)event.step, InputNames[event.type],
+            event.value[0], event.value[1], event.value[2]);
+}
+
+void stop_input_record(GLuint64 step) {
+    if (!recordFile) {
+        return;
+    }
+    InputEvent end = {step, EndInput, {0.0f, 0.0f, 0.0f}};
+    record_input(end);
+    fclose(recordFile);
+    recordFile = NULL;
+}
+
+bool load_input_log(const char *filename, vector<InputEvent> &events) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "ERROR: could not open input log %s\n", filename);
+        return false;
+    }
+    char line[256];
+    if (!fgets(line, sizeof(line), file) || strncmp(line, InputLogHeader, strlen(InputLogHeader)) != 0) {
+        fprintf(stderr, "ERROR: %s is not an input log\n", filename);
+        fclose(file);
+        return false;
+    }
+
+    events.clear();
+    int number = 1;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        unsigned long long step;
+        char name[32];
+        InputEvent event = {0, -1, {0.0f, 0.0f, 0.0f}};
+        if (sscanf(line, "%llu %31s %f %f %f", &step, name, &event.value[0], &event.value[1], &event.value[2]) < 2) {
+            continue;
+        }
+        for (int t = 0; t < NumInputTypes; t++) {
+            if (strcmp(name, InputNames[t]) == 0) {
+                event.type = t;
+            }
+        }
+        event.step = step;
+        if (event.type < 0 || (!events.empty() && event.step < events.back().step)) {
+            fprintf(stderr, "ERROR: bad input at %s:%d\n", filename, number);
+            fclose(file);
+            return false;
+        }
+        events.push_back(event);
+    }
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,35 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <vector>
+#include "../common/vgl.h"
+
+// Simulation inputs stamped with the step they were applied before. Inputs are logged after
+// scene queries have resolved them (a move carries the eye position it reached, a click the
+// switch it hit), so replaying a log reproduces the same simulation without the renderer.
+// Logs are text, one input per line: step, type name and up to three values.
+
+enum InputTypes {TurnInput, MoveInput, SwitchInput, BlindsInput, CullingInput, StatsInput, EndInput, NumInputTypes};
+
+struct InputEvent {
+    GLuint64 step;
+    GLint type;
+    GLfloat value[3];
+};
+
+// Start writing inputs to file (returns false if it could not be created)
+bool start_input_record(const char *filename);
+
+// Append input to open log
+void record_input(const InputEvent &event);
+
+// Mark end of recording at step and close log
+void stop_input_record(GLuint64 step);
+
+// Read inputs of log in step order (returns false if missing or malformed)
+bool load_input_log(const char *filename, std::vector<InputEvent> &events);
+
+#endif
@@ -0,0 +1,289 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "../common/objloader.h"
+#include "../common/vmath.h"
+#include "mesh_cache.h"
+#include "tangents.h"
+
+using namespace vmath;
+using namespace std;
+
+// Fixed size cache header
+struct MeshCacheHeader {
+    char magic[4];
+    GLuint version;
+    long long sourceTime;
+    long long sourceSize;
+    GLuint numVertices;
+    GLuint numIndices;
+    GLuint numLods;
+    GLuint hasTangents;
+    GLuint lodOffset[MaxMeshLods];
+    GLuint lodCount[MaxMeshLods];
+    GLfloat bounds[4];
+    GLfloat box[6];
+};
+
+// Welding key (position, normal and texture coordinate)
+struct WeldKey {
+    GLfloat v[9];
+    bool operator==(const WeldKey &o) const { return memcmp(v, o.v, sizeof(v)) == 0; }
+};
+
+struct WeldKeyHash {
+    size_t operator()(const WeldKey &k) const {
+        // FNV-1a over key bytes
+        const unsigned char *p = (const unsigned char *)k.v;
+        size_t h = 2166136261u;
+        for (size_t i = 0; i < sizeof(k.v); i++) {
+            h = (h ^ p[i])*16777619u;
+        }
+        return h;
+    }
+};
+
+string mesh_cache_path(const char *filename) {
+    return string(filename) + ".meshcache";
+}
+
+// Size of mapped cache for given counts
+static size_t mesh_cache_size(GLuint numVertices, GLuint numIndices, bool tangents) {
+    return sizeof(MeshCacheHeader) + sizeof(GLfloat)*numVertices*(4 + 3 + 2 + (tangents ? 4 : 0)) + sizeof(GLuint)*numIndices;
+}
+
+// Load OBJ, weld duplicate vertices, generate tangents if requested, simplify and write cache
+static bool build_mesh_cache(const char *filename, const struct stat &src, bool tangents, MappedMesh &mesh, ThreadPool *pool) {
+    vector<vec4> vertices;
+    vector<vec2> uvCoords;
+    vector<vec3> normals;
+
+    loadOBJ(filename, vertices, uvCoords, normals);
+    if (vertices.empty() || uvCoords.size() != vertices.size() || normals.size() != vertices.size()) {
+        fprintf(stderr, "ERROR: could not load model %s\n", filename);
+        return false;
+    }
+
+    // Weld corners sharing position, normal and texture coordinate
+    unordered_map<WeldKey, GLuint, WeldKeyHash> welded;
+    vector<vec4> outPos;
+    vector<vec3> outNorm;
+    vector<vec2> outUV;
+    vector<GLuint> indices;
+    indices.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        WeldKey key = {{vertices[i][0], vertices[i][1], vertices[i][2],
+                        normals[i][0], normals[i][1], normals[i][2],
+                        uvCoords[i][0], uvCoords[i][1], vertices[i][3]}};
+        unordered_map<WeldKey, GLuint, WeldKeyHash>::iterator it = welded.find(key);
+        if (it != welded.end()) {
+            indices.push_back(it->second);
+            continue;
+        }
+        GLuint index = outPos.size();
+        welded[key] = index;
+        outPos.push_back(vertices[i]);
+        outNorm.push_back(normals[i]);
+        outUV.push_back(uvCoords[i]);
+        indices.push_back(index);
+    }
+
+    // Tangents on welded mesh so shared vertices get one smooth frame
+    vector<vec4> outTang;
+    if (tangents) {
+        generate_tangents(outPos, outNorm, outUV, indices, outTang, pool);
+    }
+
+    // Bounding sphere around box center
+    vec3 lo = vec3(outPos[0][0], outPos[0][1], outPos[0][2]);
+    vec3 hi = lo;
+    for (size_t i = 1; i < outPos.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            lo[k] = outPos[i][k] < lo[k] ? outPos[i][k] : lo[k];
+            hi[k] = outPos[i][k] > hi[k] ? outPos[i][k] : hi[k];
+        }
+    }
+    vec3 center = (lo + hi)*0.5f;
+    GLfloat radius = 0.0f;
+    for (size_t i = 0; i < outPos.size(); i++) {
+        GLfloat d = length(vec3(outPos[i][0], outPos[i][1], outPos[i][2]) - center);
+        radius = d > radius ? d : radius;
+    }
+
+    // Coarser levels share vertices and follow full resolution indices
+    vector<vector<GLuint> > lods;
+    build_mesh_lods(outPos, outNorm, outUV, indices, radius, lods);
+
+    // Lay out cache image in memory
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "MESH", 4);
+    header.version = MESH_CACHE_VERSION;
+    header.sourceTime = src.st_mtime;
+    header.sourceSize = src.st_size;
+    header.numVertices = outPos.size();
+    header.numLods = lods.size() + 1;
+    header.hasTangents = tangents;
+    header.lodCount[0] = indices.size();
+    for (size_t l = 0; l < lods.size(); l++) {
+        header.lodOffset[l + 1] = indices.size();
+        header.lodCount[l + 1] = lods[l].size();
+        indices.insert(indices.end(), lods[l].begin(), lods[l].end());
+    }
+    header.numIndices = indices.size();
+    header.bounds[0] = center[0];
+    header.bounds[1] = center[1];
+    header.bounds[2] = center[2];
+    header.bounds[3] = radius;
+    for (int k = 0; k < 3; k++) {
+        header.box[k] = lo[k];
+        header.box[3 + k] = hi[k];
+    }
+    mesh.size = mesh_cache_size(header.numVertices, header.numIndices, tangents);
+    mesh.base = malloc(mesh.size);
+    mesh.heap = true;
+    char *p = (char *)mesh.base;
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, outPos.data(), sizeof(GLfloat)*4*outPos.size());
+    p += sizeof(GLfloat)*4*outPos.size();
+    memcpy(p, outNorm.data(), sizeof(GLfloat)*3*outNorm.size());
+    p += sizeof(GLfloat)*3*outNorm.size();
+    memcpy(p, outUV.data(), sizeof(GLfloat)*2*outUV.size());
+    p += sizeof(GLfloat)*2*outUV.size();
+    memcpy(p, outTang.data(), sizeof(GLfloat)*4*outTang.size());
+    p += sizeof(GLfloat)*4*outTang.size();
+    memcpy(p, indices.data(), sizeof(GLuint)*indices.size());
+
+    // Save for next run (mesh is still usable from memory if this fails)
+    string path = mesh_cache_path(filename);
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp || fwrite(mesh.base, 1, mesh.size, fp) != mesh.size) {
+        fprintf(stderr, "WARNING: could not write mesh cache %s\n", path.c_str());
+    }
+    if (fp) {
+        fclose(fp);
+    }
+    return true;
+}
+
+// Map whole file read-only
+static void *map_file(const char *path, size_t &size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    size = (size_t)file_size.QuadPart;
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) {
+        return NULL;
+    }
+    void *base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    return base;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size = st.st_size;
+    void *base = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    return base == MAP_FAILED ? NULL : base;
+#endif
+}
+
+static void unmap_file(void *base, size_t size) {
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+// Validate cache image against source file and locate its streams
+// (caches built without tangents are stale when tangents are requested)
+static bool parse_mesh_cache(const struct stat &src, bool tangents, MappedMesh &mesh) {
+    const MeshCacheHeader *header = (const MeshCacheHeader *)mesh.base;
+    if (mesh.size < sizeof(MeshCacheHeader) || memcmp(header->magic, "MESH", 4) != 0 ||
+        header->version != MESH_CACHE_VERSION || header->sourceTime != (long long)src.st_mtime ||
+        header->sourceSize != (long long)src.st_size || (tangents && !header->hasTangents) ||
+        mesh.size != mesh_cache_size(header->numVertices, header->numIndices, header->hasTangents != 0)) {
+        return false;
+    }
+
+    if (header->numLods == 0 || header->numLods > MaxMeshLods) {
+        return false;
+    }
+    for (GLuint l = 0; l < header->numLods; l++) {
+        if (header->lodOffset[l] + header->lodCount[l] > header->numIndices) {
+            return false;
+        }
+    }
+
+    mesh.numVertices = header->numVertices;
+    mesh.numIndices = header->numIndices;
+    mesh.numLods = header->numLods;
+    memcpy(mesh.lodOffset, header->lodOffset, sizeof(mesh.lodOffset));
+    memcpy(mesh.lodCount, header->lodCount, sizeof(mesh.lodCount));
+    memcpy(mesh.bounds, header->bounds, sizeof(mesh.bounds));
+    memcpy(mesh.box, header->box, sizeof(mesh.box));
+    const GLfloat *streams = (const GLfloat *)(header + 1);
+    mesh.positions = streams;
+    mesh.normals = mesh.positions + 4*mesh.numVertices;
+    mesh.uvCoords = mesh.normals + 3*mesh.numVertices;
+    mesh.tangents = header->hasTangents ? mesh.uvCoords + 2*mesh.numVertices : NULL;
+    mesh.indices = (const GLuint *)(mesh.uvCoords + (header->hasTangents ? 6 : 2)*mesh.numVertices);
+    return true;
+}
+
+bool open_mesh_cache(const char *filename, bool tangents, MappedMesh &mesh, ThreadPool *pool) {
+    struct stat src;
+    memset(&mesh, 0, sizeof(mesh));
+    if (stat(filename, &src) != 0) {
+        fprintf(stderr, "ERROR: could not find model %s\n", filename);
+        return false;
+    }
+
+    string path = mesh_cache_path(filename);
+    mesh.base = map_file(path.c_str(), mesh.size);
+    if (mesh.base && parse_mesh_cache(src, tangents, mesh)) {
+        return true;
+    }
+    // Missing or stale cache
+    close_mesh_cache(mesh);
+    if (!build_mesh_cache(filename, src, tangents, mesh, pool)) {
+        return false;
+    }
+    return parse_mesh_cache(src, tangents, mesh);
+}
+
+void close_mesh_cache(MappedMesh &mesh) {
+    if (mesh.base && mesh.heap) {
+        free(mesh.base);
+    } else if (mesh.base) {
+        unmap_file(mesh.base, mesh.size);
+    }
+    mesh.base = NULL;
+    mesh.heap = false;
+    mesh.size = 0;
+}
@@ -0,0 +1,48 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include "../common/vgl.h"
+#include "mesh_lod.h"
+#include "thread_pool.h"
+
+// Binary mesh cache (.meshcache) stored next to source model
+//   header: "MESH", version, source modification time and size, vertex and index counts,
+//           tangent flag, level of detail index ranges, bounding sphere and box
+//   streams: positions (4 floats), normals (3), texture coords (2), tangents with handedness (4,
+//            only if flagged) and triangle indices (all levels, finest first), each ready for glBufferData
+const GLuint MESH_CACHE_VERSION = 5;
+
+// Read-only view of a memory mapped mesh cache
+struct MappedMesh {
+    void *base;
+    size_t size;
+    bool heap;          // freshly built cache held in memory instead of mapped
+    GLuint numVertices;
+    GLuint numIndices;
+    GLuint numLods;
+    GLuint lodOffset[MaxMeshLods];  // first index of each level
+    GLuint lodCount[MaxMeshLods];   // index count of each level
+    GLfloat bounds[4];              // bounding sphere center and radius
+    GLfloat box[6];                 // bounding box min and max corners
+    const GLfloat *positions;
+    const GLfloat *normals;
+    const GLfloat *uvCoords;
+    const GLfloat *tangents;        // NULL if cache has no tangent stream
+    const GLuint *indices;
+};
+
+// Path of cache file for source model
+std::string mesh_cache_path(const char *filename);
+
+// Map cache for model, rebuilding it from the OBJ source if missing, stale or lacking requested tangents
+// (tangent generation is spread over pool workers when given)
+bool open_mesh_cache(const char *filename, bool tangents, MappedMesh &mesh, ThreadPool *pool = NULL);
+
+// Unmap cache file
+void close_mesh_cache(MappedMesh &mesh);
+
+#endif
@@ -0,0 +1,372 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <math.h>
+#include <string.h>
+#include <queue>
+#include <unordered_map>
+#include "mesh_lod.h"
+
+using namespace vmath;
+using namespace std;
+
+// Symmetric 4x4 plane error quadric (upper triangle, row major)
+struct Quadric {
+    double a[10];
+};
+
+// Candidate collapse of vertex from onto vertex to (versions detect stale entries)
+struct Collapse {
+    double cost;
+    GLuint from;
+    GLuint to;
+    GLuint fromVersion;
+    GLuint toVersion;
+    bool operator<(const Collapse &o) const { return cost > o.cost; }
+};
+
+struct PositionKey {
+    GLfloat v[3];
+    bool operator==(const PositionKey &o) const { return memcmp(v, o.v, sizeof(v)) == 0; }
+};
+
+struct PositionKeyHash {
+    size_t operator()(const PositionKey &k) const {
+        // FNV-1a over key bytes
+        const unsigned char *p = (const unsigned char *)k.v;
+        size_t h = 2166136261u;
+        for (size_t i = 0; i < sizeof(k.v); i++) {
+            h = (h ^ p[i])*16777619u;
+        }
+        return h;
+    }
+};
+
+static void add_plane(Quadric &q, const double n[3], double d, double w) {
+    q.a[0] += w*n[0]*n[0]; q.a[1] += w*n[0]*n[1]; q.a[2] += w*n[0]*n[2]; q.a[3] += w*n[0]*d;
+    q.a[4] += w*n[1]*n[1]; q.a[5] += w*n[1]*n[2]; q.a[6] += w*n[1]*d;
+    q.a[7] += w*n[2]*n[2]; q.a[8] += w*n[2]*d;
+    q.a[9] += w*d*d;
+}
+
+static double quadric_error(const Quadric &q, const double p[3]) {
+    const double *a = q.a;
+    double x = p[0], y = p[1], z = p[2];
+    double e = a[0]*x*x + 2*a[1]*x*y + 2*a[2]*x*z + 2*a[3]*x +
+               a[4]*y*y + 2*a[5]*y*z + 2*a[6]*y +
+               a[7]*z*z + 2*a[8]*z + a[9];
+    return e > 0.0 ? e : 0.0;
+}
+
+static void sub3(const double a[3], const double b[3], double r[3]) {
+    r[0] = a[0] - b[0];
+    r[1] = a[1] - b[1];
+    r[2] = a[2] - b[2];
+}
+
+static void cross3(const double a[3], const double b[3], double r[3]) {
+    r[0] = a[1]*b[2] - a[2]*b[1];
+    r[1] = a[2]*b[0] - a[0]*b[2];
+    r[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+static double dot3(const double a[3], const double b[3]) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// Unnormalized face normal of triangle
+static void face_normal(const double *p0, const double *p1, const double *p2, double n[3]) {
+    double e1[3], e2[3];
+    sub3(p1, p0, e1);
+    sub3(p2, p0, e2);
+    cross3(e1, e2, n);
+}
+
+// Mesh being simplified in position space (attribute seams are resolved when levels are emitted)
+class Simplifier {
+public:
+    Simplifier(const vector<vec4> &positions, const vector<GLuint> &indices);
+
+    // Collapse edges until at most target triangles remain or error limit is reached
+    void reduce(size_t target, double maxError);
+
+    size_t triangles() const { return aliveTris; }
+
+    // Current triangles as original vertex indices (closest attribute copy for moved corners)
+    void emit(const vector<vec3> &normals, const vector<vec2> &uvCoords, vector<GLuint> &out) const;
+
+private:
+    double collapse_cost(GLuint from, GLuint to) const;
+    bool collapse_flips(GLuint from, GLuint to) const;
+    void push_edges(GLuint v);
+
+    vector<double> points;              // unique positions (3 per point)
+    vector<GLuint> pointOf;             // point of each original vertex
+    vector<vector<GLuint> > copies;     // original vertices at each point
+    vector<Quadric> quadrics;
+    vector<GLuint> versions;
+    vector<bool> removed;
+    vector<GLuint> corners;             // triangle corners as points
+    vector<GLuint> sources;             // triangle corners as original vertices
+    vector<bool> alive;
+    vector<vector<GLuint> > pointTris;  // triangles touching each point
+    size_t aliveTris;
+    priority_queue<Collapse> heap;
+};
+
+Simplifier::Simplifier(const vector<vec4> &positions, const vector<GLuint> &indices) {
+    // Merge vertices split only by normal or texture coordinate so seams collapse together
+    unordered_map<PositionKey, GLuint, PositionKeyHash> unique;
+    pointOf.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        PositionKey key = {{positions[i][0], positions[i][1], positions[i][2]}};
+        unordered_map<PositionKey, GLuint, PositionKeyHash>::iterator it = unique.find(key);
+        if (it == unique.end()) {
+            GLuint point = copies.size();
+            unique[key] = point;
+            points.push_back(positions[i][0]);
+            points.push_back(positions[i][1]);
+            points.push_back(positions[i][2]);
+            copies.push_back(vector<GLuint>());
+            it = unique.find(key);
+        }
+        pointOf[i] = it->second;
+        copies[it->second].push_back(i);
+    }
+
+    size_t numPoints = copies.size();
+    Quadric zero;
+    memset(&zero, 0, sizeof(zero));
+    quadrics.assign(numPoints, zero);
+    versions.assign(numPoints, 0);
+    removed.assign(numPoints, false);
+    pointTris.resize(numPoints);
+
+    // Triangles (degenerate ones in position space are dropped)
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        GLuint p[3] = {pointOf[indices[i]], pointOf[indices[i + 1]], pointOf[indices[i + 2]]};
+        if (p[0] == p[1] || p[1] == p[2] || p[0] == p[2]) {
+            continue;
+        }
+        GLuint tri = alive.size();
+        for (int k = 0; k < 3; k++) {
+            corners.push_back(p[k]);
+            sources.push_back(indices[i + k]);
+            pointTris[p[k]].push_back(tri);
+        }
+        alive.push_back(true);
+    }
+    aliveTris = alive.size();
+
+    // Face plane quadrics and edge usage counts
+    unordered_map<unsigned long long, GLuint> edgeUse;
+    for (size_t t = 0; t < alive.size(); t++) {
+        const GLuint *c = &corners[3*t];
+        double n[3];
+        face_normal(&points[3*c[0]], &points[3*c[1]], &points[3*c[2]], n);
+        double len = sqrt(dot3(n, n));
+        if (len > 0.0) {
+            n[0] /= len;
+            n[1] /= len;
+            n[2] /= len;
+            double d = -dot3(n, &points[3*c[0]]);
+            for (int k = 0; k < 3; k++) {
+                add_plane(quadrics[c[k]], n, d, 1.0);
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            GLuint a = c[k], b = c[(k + 1)%3];
+            unsigned long long key = a < b ? ((unsigned long long)a << 32 | b) : ((unsigned long long)b << 32 | a);
+            edgeUse[key]++;
+        }
+    }
+
+    // Open borders get heavily weighted planes perpendicular to their face so outlines hold
+    for (size_t t = 0; t < alive.size(); t++) {
+        const GLuint *c = &corners[3*t];
+        double n[3];
+        face_normal(&points[3*c[0]], &points[3*c[1]], &points[3*c[2]], n);
+        for (int k = 0; k < 3; k++) {
+            GLuint a = c[k], b = c[(k + 1)%3];
+            unsigned long long key = a < b ? ((unsigned long long)a << 32 | b) : ((unsigned long long)b << 32 | a);
+            if (edgeUse[key] != 1) {
+                continue;
+            }
+            double e[3], bn[3];
+            sub3(&points[3*b], &points[3*a], e);
+            cross3(e, n, bn);
+            double len = sqrt(dot3(bn, bn));
+            if (len == 0.0) {
+                continue;
+            }
+            bn[0] /= len;
+            bn[1] /= len;
+            bn[2] /= len;
+            double d = -dot3(bn, &points[3*a]);
+            add_plane(quadrics[a], bn, d, 10.0);
+            add_plane(quadrics[b], bn, d, 10.0);
+        }
+    }
+
+    for (GLuint p = 0; p < numPoints; p++) {
+        push_edges(p);
+    }
+}
+
+// Error of moving from onto to (vertex subset collapse keeps existing positions)
+double Simplifier::collapse_cost(GLuint from, GLuint to) const {
+    const double *p = &points[3*to];
+    return quadric_error(quadrics[from], p) + quadric_error(quadrics[to], p);
+}
+
+// True if moving from onto to would fold over or collapse a surviving triangle
+bool Simplifier::collapse_flips(GLuint from, GLuint to) const {
+    const vector<GLuint> &tris = pointTris[from];
+    for (size_t i = 0; i < tris.size(); i++) {
+        GLuint t = tris[i];
+        const GLuint *c = &corners[3*t];
+        if (!alive[t] || c[0] == to || c[1] == to || c[2] == to) {
+            continue;
+        }
+        const double *p[3];
+        const double *q[3];
+        for (int k = 0; k < 3; k++) {
+            p[k] = &points[3*c[k]];
+            q[k] = c[k] == from ? &points[3*to] : p[k];
+        }
+        double before[3], after[3];
+        face_normal(p[0], p[1], p[2], before);
+        face_normal(q[0], q[1], q[2], after);
+        double lb = dot3(before, before), la = dot3(after, after);
+        if (la <= 1e-12*lb || dot3(before, after) < 0.2*sqrt(la*lb)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Queue collapses along every edge of point in both directions
+void Simplifier::push_edges(GLuint v) {
+    const vector<GLuint> &tris = pointTris[v];
+    for (size_t i = 0; i < tris.size(); i++) {
+        GLuint t = tris[i];
+        if (!alive[t]) {
+            continue;
+        }
+        for (int k = 0; k < 3; k++) {
+            GLuint n = corners[3*t + k];
+            if (n == v) {
+                continue;
+            }
+            Collapse out = {collapse_cost(v, n), v, n, versions[v], versions[n]};
+            Collapse in = {collapse_cost(n, v), n, v, versions[n], versions[v]};
+            heap.push(out);
+            heap.push(in);
+        }
+    }
+}
+
+void Simplifier::reduce(size_t target, double maxError) {
+    while (aliveTris > target && !heap.empty()) {
+        Collapse c = heap.top();
+        if (c.cost > maxError) {
+            break;
+        }
+        heap.pop();
+        if (removed[c.from] || removed[c.to] || versions[c.from] != c.fromVersion || versions[c.to] != c.toVersion) {
+            continue;
+        }
+        if (collapse_flips(c.from, c.to)) {
+            continue;
+        }
+
+        // Move triangles onto target point, dropping those spanning the collapsed edge
+        vector<GLuint> &fromTris = pointTris[c.from];
+        vector<GLuint> &toTris = pointTris[c.to];
+        for (size_t i = 0; i < fromTris.size(); i++) {
+            GLuint t = fromTris[i];
+            if (!alive[t]) {
+                continue;
+            }
+            GLuint *tc = &corners[3*t];
+            if (tc[0] == c.to || tc[1] == c.to || tc[2] == c.to) {
+                alive[t] = false;
+                aliveTris--;
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                if (tc[k] == c.from) {
+                    tc[k] = c.to;
+                }
+            }
+            toTris.push_back(t);
+        }
+        fromTris.clear();
+        removed[c.from] = true;
+        for (int k = 0; k < 10; k++) {
+            quadrics[c.to].a[k] += quadrics[c.from].a[k];
+        }
+
+        // Drop dead triangles and requeue edges around grown point
+        size_t live = 0;
+        for (size_t i = 0; i < toTris.size(); i++) {
+            if (alive[toTris[i]]) {
+                toTris[live++] = toTris[i];
+            }
+        }
+        toTris.resize(live);
+        versions[c.to]++;
+        push_edges(c.to);
+    }
+}
+
+void Simplifier::emit(const vector<vec3> &normals, const vector<vec2> &uvCoords, vector<GLuint> &out) const {
+    out.clear();
+    out.reserve(3*aliveTris);
+    for (size_t t = 0; t < alive.size(); t++) {
+        if (!alive[t]) {
+            continue;
+        }
+        for (int k = 0; k < 3; k++) {
+            GLuint source = sources[3*t + k];
+            GLuint point = corners[3*t + k];
+            if (pointOf[source] == point) {
+                out.push_back(source);
+                continue;
+            }
+            // Corner moved: reuse the copy at new point whose normal and texture coordinate match best
+            const vector<GLuint> &candidates = copies[point];
+            GLuint best = candidates[0];
+            GLfloat best_dist = 1e30f;
+            for (size_t i = 0; i < candidates.size(); i++) {
+                vec3 dn = normals[candidates[i]] - normals[source];
+                vec2 duv = uvCoords[candidates[i]] - uvCoords[source];
+                GLfloat dist = dot(dn, dn) + dot(duv, duv);
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    best = candidates[i];
+                }
+            }
+            out.push_back(best);
+        }
+    }
+}
+
+void build_mesh_lods(const vector<vec4> &positions, const vector<vec3> &normals, const vector<vec2> &uvCoords,
+                     const vector<GLuint> &indices, GLfloat radius, vector<vector<GLuint> > &lods) {
+    lods.clear();
+    Simplifier simplifier(positions, indices);
+    double maxError = (double)MaxLodError*radius*MaxLodError*radius;
+
+    size_t previous = simplifier.triangles();
+    for (GLuint lod = 1; lod < MaxMeshLods; lod++) {
+        simplifier.reduce(previous/2, maxError);
+        // Not worth a level unless it removes at least a fifth of the triangles
+        if (simplifier.triangles() == 0 || simplifier.triangles() > previous*4/5) {
+            break;
+        }
+        previous = simplifier.triangles();
+        lods.push_back(vector<GLuint>());
+        simplifier.emit(normals, uvCoords, lods.back());
+    }
+}
@@ -0,0 +1,25 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <vector>
+#include "../common/vgl.h"
+#include "../common/vmath.h"
+
+// Maximum levels of detail per mesh (level 0 is full resolution)
+const GLuint MaxMeshLods = 4;
+
+// Simplification stops once collapse error exceeds this fraction of bounding radius
+const GLfloat MaxLodError = 0.05f;
+
+// Build coarser index lists for a welded, indexed triangle mesh with quadric error edge collapses.
+// Each level keeps about half the triangles of the previous one and only references existing
+// vertices, so all levels share one vertex buffer. Fewer levels are produced when a mesh cannot
+// be reduced within MaxLodError.
+void build_mesh_lods(const std::vector<vmath::vec4> &positions, const std::vector<vmath::vec3> &normals,
+                     const std::vector<vmath::vec2> &uvCoords, const std::vector<GLuint> &indices,
+                     GLfloat radius, std::vector<std::vector<GLuint> > &lods);
+
+#endif
@@ -0,0 +1,97 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <stdio.h>
+#include <string.h>
+#include "offscreen.h"
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+
+// Core versions tried newest first (GPU culling needs 4.3, shaders need 4.0)
+static const EGLint ContextVersions[][2] = {{4, 6}, {4, 5}, {4, 3}, {4, 0}};
+
+bool create_offscreen_context() {
+    // Surfaceless platform needs no window system; fall back to default display
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display) {
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        fprintf(stderr, "ERROR: could not initialize EGL display\n");
+        return false;
+    }
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+        fprintf(stderr, "ERROR: EGL display does not support surfaceless contexts\n");
+        destroy_offscreen_context();
+        return false;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint config_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE};
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0) {
+        fprintf(stderr, "ERROR: no EGL config for desktop OpenGL\n");
+        destroy_offscreen_context();
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(ContextVersions)/sizeof(ContextVersions[0]) && context == EGL_NO_CONTEXT; i++) {
+        const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION, ContextVersions[i][0],
+                                          EGL_CONTEXT_MINOR_VERSION, ContextVersions[i][1],
+                                          EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                          EGL_NONE};
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    }
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        fprintf(stderr, "ERROR: could not create OpenGL 4 core context with EGL\n");
+        destroy_offscreen_context();
+        return false;
+    }
+
+    // GLEW built for GLX loads core entry points before failing to find a GLX display
+    glewExperimental = GL_TRUE;
+    GLenum err = glewInit();
+    if (err != GLEW_OK && err != GLEW_ERROR_NO_GLX_DISPLAY) {
+        fprintf(stderr, "ERROR: %s\n", glewGetErrorString(err));
+        destroy_offscreen_context();
+        return false;
+    }
+    printf("Offscreen context: %s (%s)\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    return true;
+}
+
+void destroy_offscreen_context() {
+    if (display == EGL_NO_DISPLAY) {
+        return;
+    }
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context != EGL_NO_CONTEXT) {
+        eglDestroyContext(display, context);
+        context = EGL_NO_CONTEXT;
+    }
+    eglTerminate(display);
+    display = EGL_NO_DISPLAY;
+}
+
+#else
+
+bool create_offscreen_context() {
+    fprintf(stderr, "ERROR: built without EGL, offscreen contexts are unavailable\n");
+    return false;
+}
+
+void destroy_offscreen_context() {
+}
+
+#endif
@@ -0,0 +1,19 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include "../common/vgl.h"
+
+// Windowless GL context for benchmarks on hosts without a display or GPU. Uses EGL on
+// the Mesa surfaceless platform (so llvmpipe works) when built with EGL; there is no
+// default framebuffer, so callers render into their own framebuffer object.
+
+// Create core profile context, make it current and load GL entry points (returns false if unavailable)
+bool create_offscreen_context();
+
+// Release context
+void destroy_offscreen_context();
+
+#endif
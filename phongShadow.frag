@@ -31,8 +31,8 @@ layout (std140) uniform MaterialBuffer {
      MaterialProperties Materials[MaxMaterials];
 };
 
-// Selected material
-uniform int Material;
+// Selected material (from vertex shader)
+flat in int ObjMaterial;
 
 // Number of lights
 uniform int NumLights;
@@ -71,7 +71,7 @@ void main()
           if (LightOn[i] != 0) {
                // Ambient component
                if (Lights[i].type != 0) {
-                    rgb += vec3(Lights[i].ambient*Materials[Material].ambient);
+                    rgb += vec3(Lights[i].ambient*Materials[ObjMaterial].ambient);
                }
                // Directional Light
                if (Lights[i].type == 1) {
@@ -79,11 +79,11 @@ void main()
                     vec3 HalfVector = normalize(LightDirection + NormView);
                     // Diffuse
                     float diff = max(0.0f, dot(NormNormal, LightDirection));
-                    rgb += diff*vec3(Lights[i].diffuse*Materials[Material].diffuse);
+                    rgb += diff*vec3(Lights[i].diffuse*Materials[ObjMaterial].diffuse);
                     if (diff > 0.0) {
                          // Specular term
-                         float spec = pow(max(0.0f, dot(Normal, HalfVector)), Materials[Material].shininess);
-                         rgb += spec*vec3(Lights[i].specular*Materials[Material].specular);
+                         float spec = pow(max(0.0f, dot(Normal, HalfVector)), Materials[ObjMaterial].shininess);
+                         rgb += spec*vec3(Lights[i].specular*Materials[ObjMaterial].specular);
                     }
                }
                // Point light
@@ -92,11 +92,11 @@ void main()
                     vec3 HalfVector = normalize(LightDirection + NormView);
                     // Diffuse
                     float diff = max(0.0f, dot(NormNormal, LightDirection));
-                    rgb += diff*vec3(Lights[i].diffuse*Materials[Material].diffuse);
+                    rgb += diff*vec3(Lights[i].diffuse*Materials[ObjMaterial].diffuse);
                     if (diff > 0.0) {
                          // Specular term
-                         float spec = pow(max(0.0f, dot(Normal, HalfVector)), Materials[Material].shininess);
-                         rgb += spec*vec3(Lights[i].specular*Materials[Material].specular);
+                         float spec = pow(max(0.0f, dot(Normal, HalfVector)), Materials[ObjMaterial].shininess);
+                         rgb += spec*vec3(Lights[i].specular*Materials[ObjMaterial].specular);
                     }
                }
                // Spot light
@@ -110,11 +110,11 @@ void main()
                          float attenuation = pow(spotCos, Lights[i].spotExponent);
                          // Diffuse
                          float diff = max(0.0f, dot(NormNormal, LightDirection))*attenuation;
-                         rgb += diff*vec3(Lights[i].diffuse*Materials[Material].diffuse);
+                         rgb += diff*vec3(Lights[i].diffuse*Materials[ObjMaterial].diffuse);
                          if (diff > 0.0) {
                               // Specular term
-                              float spec = pow(max(0.0f, dot(Normal, HalfVector)), Materials[Material].shininess)*attenuation;
-                              rgb += spec*vec3(Lights[i].specular*Materials[Material].specular);
+                              float spec = pow(max(0.0f, dot(Normal, HalfVector)), Materials[ObjMaterial].shininess)*attenuation;
+                              rgb += spec*vec3(Lights[i].specular*Materials[ObjMaterial].specular);
                          }
                     }
                }
@@ -125,5 +125,5 @@ void main()
      float shadow = 1.0 - ShadowCalculation(LightPosition);
 
      // TODO: Apply shadow attenuation to base color
-     fragColor = shadow*vec4(min(rgb,vec3(1.0)), Materials[Material].ambient.a);
+     fragColor = shadow*vec4(min(rgb,vec3(1.0)), Materials[ObjMaterial].ambient.a);
 }
@@ -11,10 +11,12 @@ uniform mat4 light_proj_matrix;
 uniform mat4 light_cam_matrix;
 
 uniform vec3 EyePosition;
+uniform int Material;
 out vec4 Position;
 out vec3 Normal;
 out vec3 View;
 out vec4 LightPosition;
+flat out int ObjMaterial;
 
 void main( )
 {
@@ -32,4 +34,7 @@ void main( )
 
     // TODO: Compute vertex in light space
     LightPosition = light_proj_matrix*(light_cam_matrix*Position);
+
+    // Pass material index to fragment shader
+    ObjMaterial = Material;
 }
@@ -0,0 +1,52 @@
+#version 430 core
+
+layout(location = 0) in vec4 vPosition;
+layout(location = 1) in vec3 vNormal;
+// Object index (per instance, offset by baseInstance of each indirect command)
+layout(location = 4) in uint vObject;
+
+// Per object transforms and material
+struct DrawObject {
+    mat4 model_matrix;
+    mat4 normal_matrix;
+    int material;
+};
+layout(std430, binding = 4) readonly buffer DrawObjects {
+    DrawObject objects[];
+};
+
+uniform mat4 proj_matrix;
+uniform mat4 camera_matrix;
+uniform mat4 light_proj_matrix;
+uniform mat4 light_cam_matrix;
+
+uniform vec3 EyePosition;
+out vec4 Position;
+out vec3 Normal;
+out vec3 View;
+out vec4 LightPosition;
+flat out int ObjMaterial;
+
+void main( )
+{
+    mat4 model_matrix = objects[vObject].model_matrix;
+    mat4 normal_matrix = objects[vObject].normal_matrix;
+
+    // Compute transformed vertex position in view space
+    gl_Position = proj_matrix*(camera_matrix*(model_matrix*vPosition));
+
+    // Compute n (transformed by normal matrix) (passed to fragment shader)
+    Normal = vec3(normalize(normal_matrix * normalize(vec4(vNormal,0.0f))));
+
+    // Compute vertex position in world coordinates (passed to fragment shader)
+    Position = model_matrix*vPosition;
+
+    // Compute v (camera location - transformed vertex) (passed to fragment shader)
+    View = normalize(EyePosition - Position.xyz);
+
+    // Compute vertex in light space
+    LightPosition = light_proj_matrix*(light_cam_matrix*Position);
+
+    // Pass material index to fragment shader
+    ObjMaterial = objects[vObject].material;
+}
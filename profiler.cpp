@@ -0,0 +1,309 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "profiler.h"
+
+using namespace std;
+
+// Trace thread of GPU scopes (CPU threads are numbered from 1 on first use)
+const int GpuThread = 0;
+
+// Finished scope in microseconds since profiler start
+struct ProfileEvent {
+    const char *name;
+    int thread;
+    GLuint64 frame;
+    double begin;
+    double duration;
+};
+
+struct OpenScope {
+    const char *name;
+    double begin;
+    GLint gpu;          // GPU scope index in current frame or -1
+};
+
+// Timestamp query pairs of one frame
+struct GpuFrame {
+    GLuint queries[2*MaxGpuScopes];
+    const char *names[MaxGpuScopes];
+    GLuint count;
+    GLuint last;        // last query issued
+    GLuint64 frame;
+    bool pending;
+};
+
+static atomic<bool> enabled(false);
+static chrono::steady_clock::time_point start;
+static FILE *traceFile = NULL;
+static FILE *csvFile = NULL;
+static bool firstEvent = true;
+static mutex eventMutex;
+static mutex fileMutex;
+static vector<ProfileEvent> events;     // finished since last profile_frame
+static atomic<GLuint64> frameIndex(0);
+static double frameBegin = 0.0;
+static atomic<int> nextThread(1);
+static thread_local int threadId = -1;
+static thread_local vector<OpenScope> openScopes;
+
+static bool gpuTiming = false;
+static GpuFrame gpuFrames[ProfileFrames];
+static GLuint gpuSlot = 0;
+static GLint64 gpuBase = 0;             // GL timestamp (ns) at profiler start...
+static double gpuBaseTime = 0.0;        // ...and matching CPU time
+static GLuint gpuDropped = 0;
+
+// Totals of events from frame statsFrom on (guarded by fileMutex)
+static vector<ProfileStat> stats;
+static vector<double> frameTimes;
+static GLuint64 statsFrom = 0;
+
+static double now_us() {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+}
+
+static int thread_id() {
+    if (threadId < 0) {
+        threadId = nextThread++;
+    }
+    return threadId;
+}
+
+// Trace metadata naming thread (caller holds fileMutex)
+static void write_thread_name(int thread, const char *name) {
+    if (traceFile) {
+        fprintf(traceFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                firstEvent ? "\n" : ",\n", thread, name);
+        firstEvent = false;
+    }
+}
+
+static void add_stat(const ProfileEvent &e) {
+    if (e.frame < statsFrom) {
+        return;
+    }
+    size_t s = 0;
+    while (s < stats.size() && strcmp(stats[s].name, e.name) != 0) {
+        s++;
+    }
+    if (s == stats.size()) {
+        ProfileStat stat = {e.name, 0, 0, 0.0, 0.0};
+        stats.push_back(stat);
+    }
+    if (e.thread == GpuThread) {
+        stats[s].gpuCount++;
+        stats[s].gpuTotal += e.duration/1000.0;
+    } else {
+        stats[s].cpuCount++;
+        stats[s].cpuTotal += e.duration/1000.0;
+    }
+}
+
+static void write_events(const vector<ProfileEvent> &done) {
+    lock_guard<mutex> lock(fileMutex);
+    for (size_t i = 0; i < done.size(); i++) {
+        const ProfileEvent &e = done[i];
+        add_stat(e);
+        if (traceFile) {
+            fprintf(traceFile, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    firstEvent ? "\n" : ",\n", e.name, e.thread, e.begin, e.duration);
+            firstEvent = false;
+        }
+        if (csvFile) {
+            fprintf(csvFile, "%llu,%d,%s,%.4f,%.4f\n", (unsigned long long)e.frame, e.thread, e.name,
+                    e.begin/1000.0, e.duration/1000.0);
+        }
+    }
+}
+
+// Append results of frame once its last query has landed (all of them unless wait is false)
+static void collect_gpu(GpuFrame &f, vector<ProfileEvent> &done, bool wait) {
+    if (!f.pending) {
+        return;
+    }
+    GLuint available = 0;
+    glGetQueryObjectuiv(f.queries[f.last], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available && !wait) {
+        return;
+    }
+    // Queries complete in order, so the rest are available too
+    for (GLuint s = 0; s < f.count; s++) {
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(f.queries[2*s], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(f.queries[2*s + 1], GL_QUERY_RESULT, &end);
+        ProfileEvent e = {f.names[s], GpuThread, f.frame, gpuBaseTime + (GLint64)(begin - gpuBase)/1000.0,
+                          (GLint64)(end - begin)/1000.0};
+        done.push_back(e);
+    }
+    f.pending = false;
+    f.count = 0;
+}
+
+bool init_profiler(const char *trace_path, const char *csv_path) {
+    start = chrono::steady_clock::now();
+    if (trace_path) {
+        traceFile = fopen(trace_path, "w");
+        if (!traceFile) {
+            fprintf(stderr, "ERROR: could not open profile trace %s\n", trace_path);
+        } else {
+            fprintf(traceFile, "{\"traceEvents\":[");
+        }
+    }
+    if (csv_path) {
+        csvFile = fopen(csv_path, "w");
+        if (!csvFile) {
+            fprintf(stderr, "ERROR: could not open profile table %s\n", csv_path);
+        } else {
+            fprintf(csvFile, "frame,thread,scope,start_ms,duration_ms\n");
+        }
+    }
+    bool opened = (!trace_path || traceFile) && (!csv_path || csvFile);
+
+    // GPU scopes need timer queries (core since 3.3)
+    gpuTiming = GLEW_ARB_timer_query != 0;
+    if (gpuTiming) {
+        for (GLuint i = 0; i < ProfileFrames; i++) {
+            glGenQueries(2*MaxGpuScopes, gpuFrames[i].queries);
+            gpuFrames[i].count = 0;
+            gpuFrames[i].pending = false;
+        }
+        glGetInteger64v(GL_TIMESTAMP, &gpuBase);
+        gpuBaseTime = now_us();
+        write_thread_name(GpuThread, "GPU");
+    }
+    enabled = true;
+    return opened;
+}
+
+void set_profile_thread(const char *name) {
+    if (!enabled) {
+        return;
+    }
+    lock_guard<mutex> lock(fileMutex);
+    write_thread_name(thread_id(), name);
+}
+
+void profile_begin(const char *name, bool gpu) {
+    if (!enabled) {
+        return;
+    }
+    OpenScope scope = {name, now_us(), -1};
+    if (gpu && gpuTiming && gpuFrames[gpuSlot].count < MaxGpuScopes) {
+        GpuFrame &f = gpuFrames[gpuSlot];
+        scope.gpu = f.count++;
+        f.names[scope.gpu] = name;
+        f.last = 2*scope.gpu;
+        glQueryCounter(f.queries[f.last], GL_TIMESTAMP);
+    }
+    openScopes.push_back(scope);
+}
+
+void profile_end() {
+    if (!enabled || openScopes.empty()) {
+        return;
+    }
+    OpenScope scope = openScopes.back();
+    openScopes.pop_back();
+    if (scope.gpu >= 0) {
+        GpuFrame &f = gpuFrames[gpuSlot];
+        f.last = 2*scope.gpu + 1;
+        glQueryCounter(f.queries[f.last], GL_TIMESTAMP);
+    }
+    ProfileEvent e = {scope.name, thread_id(), frameIndex, scope.begin, now_us() - scope.begin};
+    lock_guard<mutex> lock(eventMutex);
+    events.push_back(e);
+}
+
+void profile_frame() {
+    if (!enabled) {
+        return;
+    }
+    // Whole frame as a scope of GL thread
+    double now = now_us();
+    ProfileEvent frame = {"frame", thread_id(), frameIndex, frameBegin, now - frameBegin};
+    frameBegin = now;
+    {
+        lock_guard<mutex> lock(fileMutex);
+        if (frame.frame >= statsFrom) {
+            frameTimes.push_back(frame.duration/1000.0);
+        }
+    }
+    vector<ProfileEvent> done;
+    {
+        lock_guard<mutex> lock(eventMutex);
+        events.push_back(frame);
+        done.swap(events);
+    }
+
+    if (gpuTiming) {
+        gpuFrames[gpuSlot].frame = frameIndex;
+        gpuFrames[gpuSlot].pending = gpuFrames[gpuSlot].count > 0;
+        for (GLuint i = 0; i < ProfileFrames; i++) {
+            collect_gpu(gpuFrames[(gpuSlot + 1 + i) % ProfileFrames], done, false);
+        }
+        // Oldest frame still in flight gives up its queries to the next frame
+        gpuSlot = (gpuSlot + 1) % ProfileFrames;
+        if (gpuFrames[gpuSlot].pending) {
+            gpuDropped++;
+        }
+        gpuFrames[gpuSlot].pending = false;
+        gpuFrames[gpuSlot].count = 0;
+    }
+    frameIndex++;
+    write_events(done);
+}
+
+void reset_profile_stats() {
+    lock_guard<mutex> lock(fileMutex);
+    stats.clear();
+    frameTimes.clear();
+    statsFrom = frameIndex;
+}
+
+void profile_stats(vector<ProfileStat> &out, vector<double> &frame_ms) {
+    lock_guard<mutex> lock(fileMutex);
+    out = stats;
+    frame_ms = frameTimes;
+}
+
+void shutdown_profiler() {
+    if (!enabled) {
+        return;
+    }
+    enabled = false;
+    vector<ProfileEvent> done;
+    {
+        lock_guard<mutex> lock(eventMutex);
+        done.swap(events);
+    }
+    if (gpuTiming) {
+        for (GLuint i = 0; i < ProfileFrames; i++) {
+            collect_gpu(gpuFrames[(gpuSlot + 1 + i) % ProfileFrames], done, true);
+        }
+        for (GLuint i = 0; i < ProfileFrames; i++) {
+            glDeleteQueries(2*MaxGpuScopes, gpuFrames[i].queries);
+        }
+        if (gpuDropped > 0) {
+            printf("Profiler dropped GPU timings of %u frames still in flight\n", gpuDropped);
+        }
+    }
+    write_events(done);
+
+    lock_guard<mutex> lock(fileMutex);
+    if (traceFile) {
+        fprintf(traceFile, "\n]}\n");
+        fclose(traceFile);
+        traceFile = NULL;
+    }
+    if (csvFile) {
+        fclose(csvFile);
+        csvFile = NULL;
+    }
+}
@@ -0,0 +1,57 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include "../common/vgl.h"
+
+// Scoped CPU and GPU timing. CPU scopes may be opened on any thread and are timed with a
+// monotonic high resolution clock; GPU scopes bracket GL commands with GL_TIMESTAMP queries
+// kept in a ring of frames and read back only once available, so timing never stalls the
+// pipeline. Completed scopes stream to a Chrome trace (chrome://tracing or Perfetto) and to
+// a CSV with one row per scope per frame. Scopes are no-ops until the profiler is started.
+
+// Frames of GPU queries in flight before a frame's results are dropped
+const GLuint ProfileFrames = 4;
+
+// Most GPU scopes timed per frame (further scopes are CPU only)
+const GLuint MaxGpuScopes = 32;
+
+// Totals of scopes sharing a name (milliseconds)
+struct ProfileStat {
+    const char *name;
+    GLuint cpuCount;
+    GLuint gpuCount;
+    double cpuTotal;
+    double gpuTotal;
+};
+
+// Start recording, streaming to trace and CSV files when given (returns false if one could
+// not be opened). GPU scopes need a current context with timer queries at this point;
+// otherwise scopes are CPU only.
+bool init_profiler(const char *trace_path, const char *csv_path);
+
+// Name calling thread in trace
+void set_profile_thread(const char *name);
+
+// Open scope (name must outlive profiler); gpu also times GL commands (GL thread only)
+void profile_begin(const char *name, bool gpu = false);
+
+// Close innermost scope of calling thread
+void profile_end();
+
+// Mark end of frame on GL thread: writes finished scopes and collects available GPU results
+void profile_frame();
+
+// Restart totals from next frame (e.g. after warm up)
+void reset_profile_stats();
+
+// Totals per scope name and durations of frames recorded since start or last reset
+void profile_stats(std::vector<ProfileStat> &stats, std::vector<double> &frame_ms);
+
+// Flush remaining results, close files and release queries (GL thread)
+void shutdown_profiler();
+
+#endif
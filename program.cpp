@@ -0,0 +1,204 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <stdio.h>
+#include <string.h>
+#include "program.h"
+
+using namespace vmath;
+using namespace std;
+
+// Shader names of UniformNames and AttribNames entries
+static const char *UniformStrings[NumUniformNames] = {
+    "proj_matrix", "camera_matrix", "model_matrix", "normal_matrix", "light_proj_matrix", "light_cam_matrix",
+    "EyePosition", "NumLights", "LightOn", "Material", "baseMap", "normalMap", "shadowMap",
+    "sceneMap", "UvScale", "TexelSize", "Sharpness", "Planes", "LodScreenSize", "ProjScale",
+    "NumObjects", "Occlusion", "hiz_view_proj", "HiZSize", "HiZLevels", "hiZ", "depthMap", "Level"};
+static const char *AttribStrings[NumAttribNames] = {
+    "vPosition", "vNormal", "vColor", "vTexCoord", "vTangent", "vObject"};
+
+// Strip array suffix so "LightOn[0]" is found as "LightOn"
+static string base_name(const GLchar *name) {
+    string s(name);
+    size_t bracket = s.find('[');
+    if (bracket != string::npos) {
+        s.erase(bracket);
+    }
+    return s;
+}
+
+// Mark every renderer name as not active
+static void clear_slots(ShaderProgram &prog) {
+    for (int i = 0; i < NumUniformNames; i++) {
+        prog.uniformSlots[i] = -1;
+    }
+    for (int i = 0; i < NumAttribNames; i++) {
+        prog.attribLocations[i] = -1;
+    }
+}
+
+ShaderProgram::ShaderProgram() : id(0) {
+    clear_slots(*this);
+}
+
+bool load_program(ShaderProgram &prog, ShaderInfo *shaders) {
+    GLint count = 0;
+    GLint max_len = 0;
+    GLint status = GL_FALSE;
+
+    prog.uniforms.clear();
+    prog.blocks.clear();
+    prog.attribs.clear();
+    clear_slots(prog);
+
+    prog.id = LoadShaders(shaders);
+    if (prog.id == 0) {
+        fprintf(stderr, "ERROR: could not load shader program %s\n", shaders[0].filename);
+        return false;
+    }
+    glGetProgramiv(prog.id, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        fprintf(stderr, "ERROR: shader program %s failed to link\n", shaders[0].filename);
+        return false;
+    }
+
+    // Uniforms (block members have no location and are skipped)
+    glGetProgramiv(prog.id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(prog.id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len);
+    vector<GLchar> name(max_len + 1);
+    for (GLint i = 0; i < count; i++) {
+        UniformInfo uniform;
+        GLsizei len = 0;
+        glGetActiveUniform(prog.id, i, max_len, &len, &uniform.size, &uniform.type, name.data());
+        uniform.location = glGetUniformLocation(prog.id, name.data());
+        if (uniform.location < 0) {
+            continue;
+        }
+        uniform.name = base_name(name.data());
+        uniform.valid = false;
+        prog.uniforms.push_back(uniform);
+    }
+
+    // Uniform blocks
+    glGetProgramiv(prog.id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(prog.id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_len);
+    name.resize(max_len + 1);
+    for (GLint i = 0; i < count; i++) {
+        BlockInfo block;
+        GLsizei len = 0;
+        glGetActiveUniformBlockName(prog.id, i, max_len, &len, name.data());
+        block.name = base_name(name.data());
+        block.index = i;
+        prog.blocks.push_back(block);
+    }
+
+    // Vertex attributes (built-ins have no location and are skipped)
+    glGetProgramiv(prog.id, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(prog.id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_len);
+    name.resize(max_len + 1);
+    for (GLint i = 0; i < count; i++) {
+        AttribInfo attrib;
+        GLsizei len = 0;
+        GLint size = 0;
+        GLenum type = GL_NONE;
+        glGetActiveAttrib(prog.id, i, max_len, &len, &size, &type, name.data());
+        attrib.location = glGetAttribLocation(prog.id, name.data());
+        if (attrib.location < 0) {
+            continue;
+        }
+        attrib.name = base_name(name.data());
+        prog.attribs.push_back(attrib);
+    }
+
+    // Resolve renderer names once so per-draw lookups are array indexing
+    for (int i = 0; i < NumUniformNames; i++) {
+        for (size_t j = 0; j < prog.uniforms.size(); j++) {
+            if (prog.uniforms[j].name == UniformStrings[i]) {
+                prog.uniformSlots[i] = (GLint)j;
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < NumAttribNames; i++) {
+        for (size_t j = 0; j < prog.attribs.size(); j++) {
+            if (prog.attribs[j].name == AttribStrings[i]) {
+                prog.attribLocations[i] = prog.attribs[j].location;
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+GLint program_attrib(const ShaderProgram &prog, AttribNames attrib) {
+    return prog.attribLocations[attrib];
+}
+
+GLint program_uniform(const ShaderProgram &prog, UniformNames uniform) {
+    GLint slot = prog.uniformSlots[uniform];
+    return (slot >= 0) ? prog.uniforms[slot].location : -1;
+}
+
+GLint program_block(const ShaderProgram &prog, const char *name) {
+    for (size_t i = 0; i < prog.blocks.size(); i++) {
+        if (prog.blocks[i].name == name) {
+            return prog.blocks[i].index;
+        }
+    }
+    return -1;
+}
+
+void bind_program_block(const ShaderProgram &prog, const char *name, GLuint binding) {
+    GLint index = program_block(prog, name);
+    if (index >= 0) {
+        glUniformBlockBinding(prog.id, index, binding);
+    }
+}
+
+// Update shadow copy of uniform value and return uniform if an upload is needed
+static UniformInfo *stage_uniform(ShaderProgram &prog, UniformNames name, const void *data, size_t bytes) {
+    GLint slot = prog.uniformSlots[name];
+    // Uniform not active in program
+    if (slot < 0) {
+        return NULL;
+    }
+    UniformInfo *uniform = &prog.uniforms[slot];
+    // Value unchanged since last upload
+    if (uniform->valid && uniform->value.size() == bytes && memcmp(uniform->value.data(), data, bytes) == 0) {
+        return NULL;
+    }
+    uniform->value.assign((const GLubyte *)data, (const GLubyte *)data + bytes);
+    uniform->valid = true;
+    return uniform;
+}
+
+void set_uniform(ShaderProgram &prog, UniformNames name, GLint value) {
+    UniformInfo *uniform = stage_uniform(prog, name, &value, sizeof(GLint));
+    if (uniform) {
+        glUniform1i(uniform->location, value);
+    }
+}
+
+void set_uniform(ShaderProgram &prog, UniformNames name, const GLint *values, GLsizei count) {
+    UniformInfo *uniform = stage_uniform(prog, name, values, sizeof(GLint)*count);
+    if (uniform) {
+        glUniform1iv(uniform->location, count, values);
+    }
+}
+
+void set_uniform(ShaderProgram &prog, UniformNames name, const vec3 &value) {
+    const GLfloat *data = value;
+    UniformInfo *uniform = stage_uniform(prog, name, data, sizeof(GLfloat)*3);
+    if (uniform) {
+        glUniform3fv(uniform->location, 1, data);
+    }
+}
+
+void set_uniform(ShaderProgram &prog, UniformNames name, const mat4 &value) {
+    const GLfloat *data = value;
+    UniformInfo *uniform = stage_uniform(prog, name, data, sizeof(GLfloat)*16);
+    if (uniform) {
+        glUniformMatrix4fv(uniform->location, 1, GL_FALSE, data);
+    }
+}
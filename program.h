@@ -0,0 +1,75 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <string>
+#include <vector>
+#include "../common/vgl.h"
+#include "../common/utils.h"
+#include "../common/vmath.h"
+
+// Uniforms set by the renderer (resolved to per-program slots at load time)
+enum UniformNames {UniProjMatrix, UniCameraMatrix, UniModelMatrix, UniNormalMatrix, UniLightProjMatrix, UniLightCamMatrix,
+                   UniEyePosition, UniNumLights, UniLightOn, UniMaterial, UniBaseMap, UniNormalMap, UniShadowMap,
+                   UniSceneMap, UniUvScale, UniTexelSize, UniSharpness, UniPlanes, UniLodScreenSize, UniProjScale,
+                   UniNumObjects, UniOcclusion, UniHiZViewProj, UniHiZSize, UniHiZLevels, UniHiZ, UniDepthMap, UniLevel,
+                   NumUniformNames};
+
+// Vertex attributes read by the renderer
+enum AttribNames {AttrPosition, AttrNormal, AttrColor, AttrTexCoord, AttrTangent, AttrObject, NumAttribNames};
+
+// Active uniform discovered at link time with a shadow copy of its last value
+struct UniformInfo {
+    std::string name;
+    GLint location;
+    GLenum type;
+    GLint size;
+    bool valid;
+    std::vector<GLubyte> value;
+};
+
+// Active uniform block discovered at link time
+struct BlockInfo {
+    std::string name;
+    GLuint index;
+};
+
+// Active vertex attribute discovered at link time
+struct AttribInfo {
+    std::string name;
+    GLint location;
+};
+
+// Shader program with reflected interface
+struct ShaderProgram {
+    GLuint id;
+    std::vector<UniformInfo> uniforms;
+    std::vector<BlockInfo> blocks;
+    std::vector<AttribInfo> attribs;
+    // Index into uniforms and attribute location per name (-1 if not active)
+    GLint uniformSlots[NumUniformNames];
+    GLint attribLocations[NumAttribNames];
+
+    ShaderProgram();
+};
+
+// Load, link and reflect shader program (returns false if linking failed)
+bool load_program(ShaderProgram &prog, ShaderInfo *shaders);
+
+// Reflection queries (return -1 if not active in program)
+GLint program_attrib(const ShaderProgram &prog, AttribNames attrib);
+GLint program_uniform(const ShaderProgram &prog, UniformNames uniform);
+GLint program_block(const ShaderProgram &prog, const char *name);
+
+// Bind uniform block to binding point (ignored if block is not active)
+void bind_program_block(const ShaderProgram &prog, const char *name, GLuint binding);
+
+// Set uniforms of currently used program, skipping uploads of unchanged values
+void set_uniform(ShaderProgram &prog, UniformNames name, GLint value);
+void set_uniform(ShaderProgram &prog, UniformNames name, const GLint *values, GLsizei count);
+void set_uniform(ShaderProgram &prog, UniformNames name, const vmath::vec3 &value);
+void set_uniform(ShaderProgram &prog, UniformNames name, const vmath::mat4 &value);
+
+#endif
@@ -0,0 +1,114 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <stddef.h>
+#include <vector>
+#include "gl_state.h"
+#include "staging.h"
+
+using namespace std;
+
+// Staging buffer, fence guarding its last transfers and order they were submitted in
+struct StagingBuffer {
+    GLuint id;
+    GLsizeiptr size;
+    GLsync fence;
+    GLuint64 submitted;
+};
+
+static vector<StagingBuffer> staging;
+static int current = -1;
+static GLuint64 submissions = 0;
+
+// Wait for staging buffer transfers and mark it free
+static void wait_staging(StagingBuffer &buffer) {
+    if (buffer.fence) {
+        glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(buffer.fence);
+        buffer.fence = 0;
+    }
+}
+
+GLubyte *begin_staging(GLsizeiptr size) {
+    poll_staging();
+
+    // Smallest free buffer that fits
+    current = -1;
+    for (size_t i = 0; i < staging.size(); i++) {
+        if (!staging[i].fence && staging[i].size >= size &&
+            (current < 0 || staging[i].size < staging[current].size)) {
+            current = i;
+        }
+    }
+    if (current < 0 && staging.size() < MaxStagingBuffers) {
+        StagingBuffer buffer = {0, 0, 0, 0};
+        glGenBuffers(1, &buffer.id);
+        staging.push_back(buffer);
+        current = staging.size() - 1;
+    }
+    if (current < 0) {
+        // Every buffer is busy or too small: grow a free one, otherwise wait on oldest submission
+        for (size_t i = 0; i < staging.size() && current < 0; i++) {
+            if (!staging[i].fence) {
+                current = i;
+            }
+        }
+        if (current < 0) {
+            current = 0;
+            for (size_t i = 1; i < staging.size(); i++) {
+                if (staging[i].submitted < staging[current].submitted) {
+                    current = i;
+                }
+            }
+            wait_staging(staging[current]);
+        }
+    }
+
+    StagingBuffer &buffer = staging[current];
+    state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+    if (buffer.size < size) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        buffer.size = size;
+    }
+    // Buffer is known idle so the driver does not need to synchronize
+    return (GLubyte *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void end_staging() {
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+}
+
+void submit_staging() {
+    if (current >= 0) {
+        staging[current].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        staging[current].submitted = ++submissions;
+        current = -1;
+    }
+    state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+GLuint poll_staging() {
+    GLuint busy = 0;
+    for (size_t i = 0; i < staging.size(); i++) {
+        if (!staging[i].fence) {
+            continue;
+        }
+        GLenum status = glClientWaitSync(staging[i].fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            glDeleteSync(staging[i].fence);
+            staging[i].fence = 0;
+        } else {
+            busy++;
+        }
+    }
+    return busy;
+}
+
+void destroy_staging() {
+    for (size_t i = 0; i < staging.size(); i++) {
+        wait_staging(staging[i]);
+        state_delete_buffers(1, &staging[i].id);
+    }
+    staging.clear();
+}
@@ -0,0 +1,31 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef STAGING_H
+#define STAGING_H
+
+#include "../common/vgl.h"
+
+// Pool of pixel unpack buffers (PBOs) for asynchronous texture uploads
+// (a buffer is recycled once the fence after its transfers has signaled)
+
+// Maximum number of staging buffers alive at once
+const GLuint MaxStagingBuffers = 4;
+
+// Bind a free staging buffer of at least size bytes to GL_PIXEL_UNPACK_BUFFER
+// and map it for writing (waits for oldest transfer if all buffers are busy)
+GLubyte *begin_staging(GLsizeiptr size);
+
+// Unmap staging buffer (transfers sourced from it may then be issued)
+void end_staging();
+
+// Fence transfers issued from current staging buffer and unbind it
+void submit_staging();
+
+// Recycle staging buffers whose transfers have completed (returns number still busy)
+GLuint poll_staging();
+
+// Release all staging buffers (waits for pending transfers)
+void destroy_staging();
+
+#endif
@@ -0,0 +1,110 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <math.h>
+#include "tangents.h"
+
+using namespace vmath;
+using namespace std;
+
+// Component of v perpendicular to unit normal n
+static vec3 project_to_plane(const vec3 &v, const vec3 &n) {
+    return v - n*dot(n, v);
+}
+
+static vec3 safe_normalize(const vec3 &v) {
+    GLfloat len = length(v);
+    return len > 1e-20f ? v/len : vec3(0.0f, 0.0f, 0.0f);
+}
+
+// Any unit vector perpendicular to n (for vertices without usable texture coordinates)
+static vec3 any_perpendicular(const vec3 &n) {
+    vec3 axis = fabs(n[0]) < 0.9f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+    return safe_normalize(project_to_plane(axis, n));
+}
+
+void generate_tangents(const vector<vec4> &positions, const vector<vec3> &normals, const vector<vec2> &uvCoords,
+                       const vector<GLuint> &indices, vector<vec4> &tangents, ThreadPool *pool) {
+    size_t numVertices = positions.size();
+    size_t numCorners = indices.empty() ? numVertices : indices.size();
+    size_t numTris = numCorners/3;
+    vector<vec3> cornerTangent(numCorners);
+    vector<vec3> cornerBitangent(numCorners);
+
+    // Per corner contributions from triangle UV derivatives
+    parallel_for(pool, numTris, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            GLuint v[3];
+            for (int k = 0; k < 3; k++) {
+                v[k] = indices.empty() ? (GLuint)(3*t + k) : indices[3*t + k];
+            }
+            vec3 p[3];
+            for (int k = 0; k < 3; k++) {
+                p[k] = vec3(positions[v[k]][0], positions[v[k]][1], positions[v[k]][2]);
+            }
+            vec3 e1 = p[1] - p[0];
+            vec3 e2 = p[2] - p[0];
+            vec2 d1 = uvCoords[v[1]] - uvCoords[v[0]];
+            vec2 d2 = uvCoords[v[2]] - uvCoords[v[0]];
+
+            // Degenerate UV mapping contributes nothing (resolved per vertex below)
+            GLfloat det = d1[0]*d2[1] - d2[0]*d1[1];
+            if (fabs(det) < 1e-20f) {
+                for (int k = 0; k < 3; k++) {
+                    cornerTangent[3*t + k] = vec3(0.0f, 0.0f, 0.0f);
+                    cornerBitangent[3*t + k] = vec3(0.0f, 0.0f, 0.0f);
+                }
+                continue;
+            }
+            // Direction only (as MikkTSpace), so triangle UV area does not bias the sum
+            vec3 sdir = (e1*d2[1] - e2*d1[1])*(det > 0.0f ? 1.0f : -1.0f);
+            vec3 tdir = (e2*d1[0] - e1*d2[0])*(det > 0.0f ? 1.0f : -1.0f);
+
+            for (int k = 0; k < 3; k++) {
+                vec3 n = safe_normalize(normals[v[k]]);
+                // Angle of triangle at this corner
+                vec3 a = safe_normalize(project_to_plane(p[(k + 1)%3] - p[k], n));
+                vec3 b = safe_normalize(project_to_plane(p[(k + 2)%3] - p[k], n));
+                GLfloat c = dot(a, b);
+                c = c > 1.0f ? 1.0f : (c < -1.0f ? -1.0f : c);
+                GLfloat angle = acos(c);
+                cornerTangent[3*t + k] = safe_normalize(project_to_plane(sdir, n))*angle;
+                cornerBitangent[3*t + k] = safe_normalize(project_to_plane(tdir, n))*angle;
+            }
+        }
+    });
+
+    // Corners of each vertex (compressed row lists)
+    vector<GLuint> first(numVertices + 1, 0);
+    vector<GLuint> corners(numTris*3);
+    for (size_t i = 0; i < numTris*3; i++) {
+        first[(indices.empty() ? i : indices[i]) + 1]++;
+    }
+    for (size_t v = 0; v < numVertices; v++) {
+        first[v + 1] += first[v];
+    }
+    vector<GLuint> fill(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < numTris*3; i++) {
+        corners[fill[indices.empty() ? i : indices[i]]++] = i;
+    }
+
+    // Sum per vertex, orthogonalize against normal and record handedness
+    tangents.resize(numVertices);
+    parallel_for(pool, numVertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            vec3 t(0.0f, 0.0f, 0.0f);
+            vec3 b(0.0f, 0.0f, 0.0f);
+            for (GLuint c = first[v]; c < first[v + 1]; c++) {
+                t += cornerTangent[corners[c]];
+                b += cornerBitangent[corners[c]];
+            }
+            vec3 n = safe_normalize(normals[v]);
+            t = safe_normalize(project_to_plane(t, n));
+            if (dot(t, t) == 0.0f) {
+                t = any_perpendicular(n);
+            }
+            GLfloat w = dot(cross(n, t), b) < 0.0f ? -1.0f : 1.0f;
+            tangents[v] = vec4(t[0], t[1], t[2], w);
+        }
+    });
+}
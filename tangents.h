@@ -0,0 +1,21 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef TANGENTS_H
+#define TANGENTS_H
+
+#include <vector>
+#include "../common/vgl.h"
+#include "../common/vmath.h"
+#include "thread_pool.h"
+
+// Generate per vertex tangents following the MikkTSpace conventions: triangle UV derivatives are
+// projected onto each corner's normal plane, weighted by corner angle, summed per vertex and
+// Gram-Schmidt orthogonalized. Tangent w holds bitangent handedness, so shaders rebuild the
+// bitangent as w*cross(normal, tangent). Empty indices treat the vertices as a triangle list.
+// Work is split over the pool's workers when one is given.
+void generate_tangents(const std::vector<vmath::vec4> &positions, const std::vector<vmath::vec3> &normals,
+                       const std::vector<vmath::vec2> &uvCoords, const std::vector<GLuint> &indices,
+                       std::vector<vmath::vec4> &tangents, ThreadPool *pool);
+
+#endif
@@ -0,0 +1,60 @@
+// CS370 Final Project
+// Fall 2023
+// Offline texture cooker: texcook [--normal|--mask] [--invert] <image> [output]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../common/stb_image.h"	// Sean Barrett's image loader - http://nothings.org/
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "image.h"
+#include "texfile.h"
+
+using namespace std;
+
+int main(int argc, char**argv)
+{
+    bool normalMap = false;
+    bool mask = false;
+    bool invert = false;
+    const char *input = NULL;
+    const char *output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--normal") == 0) {
+            normalMap = true;
+        } else if (strcmp(argv[i], "--mask") == 0) {
+            mask = true;
+        } else if (strcmp(argv[i], "--invert") == 0) {
+            invert = true;
+        } else if (!input) {
+            input = argv[i];
+        } else {
+            output = argv[i];
+        }
+    }
+    if (!input) {
+        fprintf(stderr, "usage: texcook [--normal|--mask] [--invert] <image> [output]\n");
+        return 1;
+    }
+    string out_path = output ? string(output) : cooked_path(input);
+
+    // Decode to channels used by texture role and build full mip chain before compressing
+    Image image;
+    GLint channels = normalMap ? 2 : mask ? 1 : albedo_channels(input);
+    if (!decode_image(input, image, channels, invert, true)) {
+        return 1;
+    }
+    GLenum format = choose_compressed_format(image);
+    compress_image(image, format);
+    if (!write_cooked_texture(out_path.c_str(), image)) {
+        return 1;
+    }
+
+    const char *name = format == GL_COMPRESSED_RG_RGTC2 ? "BC5" :
+                       format == GL_COMPRESSED_RED_RGTC1 ? "BC4" :
+                       format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? "BC3" : "BC1";
+    printf("%s -> %s (%s, %dx%d, %d levels)\n", input, out_path.c_str(), name,
+           image.levels[0].width, image.levels[0].height, (int)image.levels.size());
+    return 0;
+}
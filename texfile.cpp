@@ -0,0 +1,281 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "texfile.h"
+
+using namespace std;
+
+string cooked_path(const char *filename) {
+    return string(filename) + ".ctex";
+}
+
+bool cooked_is_current(const char *filename) {
+    struct stat src, dst;
+    string path = cooked_path(filename);
+    if (stat(path.c_str(), &dst) != 0) {
+        return false;
+    }
+    // Missing source still allows shipping only cooked files
+    if (stat(filename, &src) != 0) {
+        return true;
+    }
+    return dst.st_mtime >= src.st_mtime;
+}
+
+// Gather 4x4 block of channel values (edges clamped for small levels)
+static void fetch_block(const ImageLevel &level, GLint channels, GLsizei bx, GLsizei by, GLubyte block[16][4]) {
+    for (int y = 0; y < 4; y++) {
+        GLsizei sy = by*4 + y < level.height ? by*4 + y : level.height - 1;
+        for (int x = 0; x < 4; x++) {
+            GLsizei sx = bx*4 + x < level.width ? bx*4 + x : level.width - 1;
+            const GLubyte *p = &level.pixels[((size_t)sy*level.width + sx)*channels];
+            for (int k = 0; k < 4; k++) {
+                block[y*4 + x][k] = k < channels ? p[k] : 255;
+            }
+        }
+    }
+}
+
+static GLushort pack565(const int c[3]) {
+    return (GLushort)(((c[0]*31 + 127)/255) << 11 | ((c[1]*63 + 127)/255) << 5 | ((c[2]*31 + 127)/255));
+}
+
+static void unpack565(GLushort v, int c[3]) {
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 color block (always four color mode)
+static void encode_bc1(const GLubyte block[16][4], GLubyte *out) {
+    int lo[3] = {255, 255, 255};
+    int hi[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int k = 0; k < 3; k++) {
+            lo[k] = block[i][k] < lo[k] ? block[i][k] : lo[k];
+            hi[k] = block[i][k] > hi[k] ? block[i][k] : hi[k];
+        }
+    }
+
+    // Flip bounding box diagonal to follow red/blue correlation with green
+    int cov_rg = 0, cov_bg = 0;
+    int mean[3] = {(lo[0] + hi[0])/2, (lo[1] + hi[1])/2, (lo[2] + hi[2])/2};
+    for (int i = 0; i < 16; i++) {
+        cov_rg += (block[i][0] - mean[0])*(block[i][1] - mean[1]);
+        cov_bg += (block[i][2] - mean[2])*(block[i][1] - mean[1]);
+    }
+    if (cov_rg < 0) {
+        int t = lo[0]; lo[0] = hi[0]; hi[0] = t;
+    }
+    if (cov_bg < 0) {
+        int t = lo[2]; lo[2] = hi[2]; hi[2] = t;
+    }
+
+    // Inset endpoints by 1/16 of range to reduce error at extremes
+    for (int k = 0; k < 3; k++) {
+        int inset = (hi[k] - lo[k])/16;
+        hi[k] -= inset;
+        lo[k] += inset;
+    }
+
+    GLushort c0 = pack565(hi);
+    GLushort c1 = pack565(lo);
+    if (c0 < c1) {
+        GLushort t = c0; c0 = c1; c1 = t;
+    }
+
+    GLuint indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for (int k = 0; k < 3; k++) {
+            palette[2][k] = (2*palette[0][k] + palette[1][k])/3;
+            palette[3][k] = (palette[0][k] + 2*palette[1][k])/3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, best_dist = 0x7fffffff;
+            for (int p = 0; p < 4; p++) {
+                int dr = block[i][0] - palette[p][0];
+                int dg = block[i][1] - palette[p][1];
+                int db = block[i][2] - palette[p][2];
+                int dist = dr*dr + dg*dg + db*db;
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    best = p;
+                }
+            }
+            indices |= (GLuint)best << (2*i);
+        }
+    }
+
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++) {
+        out[4 + i] = (indices >> (8*i)) & 0xff;
+    }
+}
+
+// BC4 single channel block (eight value mode), also used for BC3 alpha and BC5
+static void encode_bc4(const GLubyte block[16][4], int channel, GLubyte *out) {
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++) {
+        lo = block[i][channel] < lo ? block[i][channel] : lo;
+        hi = block[i][channel] > hi ? block[i][channel] : hi;
+    }
+
+    out[0] = (GLubyte)hi;
+    out[1] = (GLubyte)lo;
+    unsigned long long indices = 0;
+    if (hi != lo) {
+        int palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for (int p = 1; p < 7; p++) {
+            palette[p + 1] = ((7 - p)*hi + p*lo + 3)/7;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, best_dist = 256;
+            for (int p = 0; p < 8; p++) {
+                int dist = block[i][channel] - palette[p];
+                dist = dist < 0 ? -dist : dist;
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    best = p;
+                }
+            }
+            indices |= (unsigned long long)best << (3*i);
+        }
+    }
+    for (int i = 0; i < 6; i++) {
+        out[2 + i] = (indices >> (8*i)) & 0xff;
+    }
+}
+
+void compress_image(Image &image, GLenum format) {
+    size_t block_bytes = (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1) ? 8 : 16;
+
+    for (size_t l = 0; l < image.levels.size(); l++) {
+        ImageLevel &level = image.levels[l];
+        GLsizei bw = (level.width + 3)/4;
+        GLsizei bh = (level.height + 3)/4;
+        vector<GLubyte> blocks((size_t)bw*bh*block_bytes);
+        GLubyte block[16][4];
+
+        for (GLsizei by = 0; by < bh; by++) {
+            for (GLsizei bx = 0; bx < bw; bx++) {
+                GLubyte *out = &blocks[((size_t)by*bw + bx)*block_bytes];
+                fetch_block(level, image.channels, bx, by, block);
+                if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) {
+                    encode_bc1(block, out);
+                } else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+                    encode_bc4(block, 3, out);
+                    encode_bc1(block, out + 8);
+                } else if (format == GL_COMPRESSED_RED_RGTC1) {
+                    encode_bc4(block, 0, out);
+                } else {
+                    encode_bc4(block, 0, out);
+                    encode_bc4(block, 1, out + 8);
+                }
+            }
+        }
+        level.pixels.swap(blocks);
+    }
+    image.format = format;
+}
+
+bool is_compressed_format(GLenum format) {
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ||
+           format == GL_COMPRESSED_RED_RGTC1 || format == GL_COMPRESSED_RG_RGTC2;
+}
+
+GLenum choose_compressed_format(const Image &image) {
+    if (image.channels == 1) {
+        return GL_COMPRESSED_RED_RGTC1;
+    }
+    if (image.channels == 2) {
+        return GL_COMPRESSED_RG_RGTC2;
+    }
+    if (image.channels == 4) {
+        const vector<GLubyte> &pixels = image.levels[0].pixels;
+        for (size_t i = 3; i < pixels.size(); i += 4) {
+            if (pixels[i] != 255) {
+                return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            }
+        }
+    }
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+bool write_cooked_texture(const char *filename, const Image &image) {
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "ERROR: could not write %s\n", filename);
+        return false;
+    }
+    GLuint header[5] = {CTEX_VERSION, image.format, (GLuint)image.levels[0].width,
+                        (GLuint)image.levels[0].height, (GLuint)image.levels.size()};
+    fwrite("CTEX", 1, 4, fp);
+    fwrite(header, sizeof(GLuint), 5, fp);
+    for (size_t l = 0; l < image.levels.size(); l++) {
+        GLuint size = image.levels[l].pixels.size();
+        fwrite(&size, sizeof(GLuint), 1, fp);
+        fwrite(image.levels[l].pixels.data(), 1, size, fp);
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+bool read_cooked_texture(const char *filename, Image &image) {
+    char magic[4];
+    GLuint header[5];
+
+    image.levels.clear();
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, "CTEX", 4) != 0 ||
+        fread(header, sizeof(GLuint), 5, fp) != 5 || header[0] != CTEX_VERSION) {
+        fprintf(stderr, "ERROR: %s is not a cooked texture\n", filename);
+        fclose(fp);
+        return false;
+    }
+
+    image.format = header[1];
+    image.channels = header[1] == GL_COMPRESSED_RED_RGTC1 ? 1 :
+                     header[1] == GL_COMPRESSED_RG_RGTC2 ? 2 :
+                     header[1] == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 3 : 4;
+    GLsizei w = header[2], h = header[3];
+    for (GLuint l = 0; l < header[4]; l++) {
+        ImageLevel level;
+        GLuint size = 0;
+        level.width = w;
+        level.height = h;
+        if (fread(&size, sizeof(GLuint), 1, fp) != 1) {
+            break;
+        }
+        level.pixels.resize(size);
+        if (fread(level.pixels.data(), 1, size, fp) != size) {
+            break;
+        }
+        image.levels.push_back(level);
+        w = w > 1 ? w/2 : 1;
+        h = h > 1 ? h/2 : 1;
+    }
+    fclose(fp);
+
+    if (image.levels.size() != header[4]) {
+        fprintf(stderr, "ERROR: cooked texture %s is truncated\n", filename);
+        image.levels.clear();
+        return false;
+    }
+    return true;
+}
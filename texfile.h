@@ -0,0 +1,35 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef TEXFILE_H
+#define TEXFILE_H
+
+#include <string>
+#include "../common/vgl.h"
+#include "image.h"
+
+// Cooked texture container (.ctex)
+//   header: "CTEX", version, GL internal format, width, height, level count
+//   levels: byte size followed by block compressed data, largest level first
+const GLuint CTEX_VERSION = 1;
+
+// Path of cooked texture for source image
+std::string cooked_path(const char *filename);
+
+// True if cooked file exists and is not older than its source image
+bool cooked_is_current(const char *filename);
+
+// Compress image (with mip levels) to BC1, BC3, BC4 or BC5 in place
+void compress_image(Image &image, GLenum format);
+
+// True for block compressed formats produced by the cooker
+bool is_compressed_format(GLenum format);
+
+// Choose BC4 for masks (R), BC5 for normal maps (RG), BC1 for opaque color and BC3 for color with alpha
+GLenum choose_compressed_format(const Image &image);
+
+// Read and write cooked container (safe to call from worker threads)
+bool write_cooked_texture(const char *filename, const Image &image);
+bool read_cooked_texture(const char *filename, Image &image);
+
+#endif
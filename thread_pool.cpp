@@ -0,0 +1,156 @@
+// CS370 Final Project
+// Fall 2023
+
+#include "thread_pool.h"
+
+using namespace std;
+
+// Pool and deque index of calling thread when it is a worker
+static thread_local ThreadPool *currentPool = NULL;
+static thread_local int currentWorker = -1;
+
+ThreadPool::ThreadPool(unsigned num_threads) : pending(0), nextQueue(0), stopping(false) {
+    if (num_threads == 0) {
+        num_threads = thread::hardware_concurrency();
+        if (num_threads == 0) {
+            num_threads = 2;
+        }
+    }
+    for (unsigned i = 0; i < num_threads; i++) {
+        queues.push_back(unique_ptr<JobDeque>(new JobDeque()));
+    }
+    for (unsigned i = 0; i < num_threads; i++) {
+        workers.push_back(thread(&ThreadPool::run, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    // Finish queued jobs then join workers
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void ThreadPool::submit(const function<void()> &job) {
+    unsigned q = currentPool == this ? (unsigned)currentWorker : nextQueue++ % (unsigned)queues.size();
+    {
+        lock_guard<mutex> lock(queues[q]->mutex);
+        queues[q]->jobs.push_back(job);
+    }
+    wake_worker();
+}
+
+void ThreadPool::submit_background(const function<void()> &job) {
+    {
+        lock_guard<mutex> lock(background.mutex);
+        background.jobs.push_back(job);
+    }
+    wake_worker();
+}
+
+void ThreadPool::wake_worker() {
+    pending++;
+    // Taking the lock orders this wake after a worker's check of pending
+    {
+        lock_guard<mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::take(int index, function<void()> &job) {
+    // Newest job of own deque
+    if (index >= 0) {
+        JobDeque &own = *queues[index];
+        lock_guard<mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+            pending--;
+            return true;
+        }
+    }
+    // Oldest job of another deque
+    unsigned count = (unsigned)queues.size();
+    unsigned start = index >= 0 ? (unsigned)index + 1 : 0;
+    for (unsigned k = 0; k < count; k++) {
+        JobDeque &victim = *queues[(start + k) % count];
+        lock_guard<mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            pending--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::take_background(function<void()> &job) {
+    lock_guard<mutex> lock(background.mutex);
+    if (background.jobs.empty()) {
+        return false;
+    }
+    job = background.jobs.front();
+    background.jobs.pop_front();
+    pending--;
+    return true;
+}
+
+bool ThreadPool::run_pending() {
+    function<void()> job;
+    if (!take(currentPool == this ? currentWorker : -1, job)) {
+        return false;
+    }
+    job();
+    return true;
+}
+
+void ThreadPool::run(unsigned index) {
+    currentPool = this;
+    currentWorker = (int)index;
+    function<void()> job;
+    while (true) {
+        if (take((int)index, job) || take_background(job)) {
+            job();
+            continue;
+        }
+        unique_lock<mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || pending > 0; });
+        if (stopping && pending <= 0) {
+            return;
+        }
+    }
+}
+
+void parallel_for(ThreadPool *pool, size_t count, const function<void(size_t begin, size_t end)> &body,
+                  size_t min_chunk) {
+    if (!pool || count <= min_chunk) {
+        body(0, count);
+        return;
+    }
+
+    // A few chunks per worker so uneven chunks still balance
+    size_t chunks = pool->size()*4;
+    size_t chunk = (count + chunks - 1)/chunks;
+    chunk = chunk < min_chunk ? min_chunk : chunk;
+    atomic<size_t> remaining((count - 1)/chunk);
+    for (size_t begin = chunk; begin < count; begin += chunk) {
+        size_t end = begin + chunk < count ? begin + chunk : count;
+        pool->submit([&body, &remaining, begin, end]() {
+            body(begin, end);
+            remaining--;
+        });
+    }
+    // First chunk runs here, then help with queued jobs until the rest are done
+    body(0, chunk);
+    while (remaining > 0) {
+        if (!pool->run_pending()) {
+            this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,113 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Blocking multi-producer/multi-consumer queue
+template <typename T>
+class WorkQueue {
+public:
+    WorkQueue() : closed(false) {}
+
+    void push(const T &item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            items.push_back(item);
+        }
+        ready.notify_one();
+    }
+
+    // Wait for next item (returns false once queue is closed and drained)
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    // Take next item without waiting (returns false if queue is empty)
+    bool try_pop(T &item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty()) {
+            return false;
+        }
+        item = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<T> items;
+    bool closed;
+};
+
+// Worker threads with one job deque each. A worker takes its own newest job first and,
+// when its deque runs dry, steals the oldest job of another worker. Jobs submitted from
+// a worker stay on its deque; jobs from other threads are dealt round robin.
+// Background jobs (long asset decodes) wait in a shared queue that only idle workers
+// take, so threads helping while they wait on short jobs never stall on them.
+class ThreadPool {
+public:
+    // Zero threads uses one worker per hardware thread
+    explicit ThreadPool(unsigned num_threads = 0);
+    ~ThreadPool();
+
+    void submit(const std::function<void()> &job);
+    void submit_background(const std::function<void()> &job);
+    unsigned size() const { return (unsigned)workers.size(); }
+
+    // Run one queued (non background) job on calling thread (returns false if none was found)
+    bool run_pending();
+
+private:
+    struct JobDeque {
+        std::mutex mutex;
+        std::deque<std::function<void()> > jobs;
+    };
+
+    void run(unsigned index);
+    bool take(int index, std::function<void()> &job);
+    bool take_background(std::function<void()> &job);
+    void wake_worker();
+
+    std::vector<std::unique_ptr<JobDeque> > queues;
+    JobDeque background;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<int> pending;       // jobs queued but not yet taken
+    std::atomic<unsigned> nextQueue;
+    bool stopping;
+};
+
+// Run body over chunks of [0, count) on pool workers and wait for all of them.
+// Runs inline without a pool or for counts up to min_chunk. The calling thread runs
+// queued jobs while it waits, so nested calls from jobs of the same pool are safe.
+void parallel_for(ThreadPool *pool, size_t count, const std::function<void(size_t begin, size_t end)> &body,
+                  size_t min_chunk = 256);
+
+#endif
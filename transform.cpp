@@ -0,0 +1,271 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <math.h>
+#include <string.h>
+#include "transform.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#define TRANSFORM_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace vmath;
+
+vec4 axis_angle(GLfloat angle, const vec3 &axis) {
+    GLfloat len = sqrt(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+    GLfloat half = angle*(GLfloat)M_PI/360.0f;
+    GLfloat s = len > 0.0f ? sin(half)/len : 0.0f;
+    return vec4(axis[0]*s, axis[1]*s, axis[2]*s, cos(half));
+}
+
+void compose_trs(const GLfloat t[3], const GLfloat q[4], const GLfloat s[3], GLfloat out[16]) {
+    GLfloat x = q[0], y = q[1], z = q[2], w = q[3];
+    GLfloat xx = x*x, yy = y*y, zz = z*z;
+    GLfloat xy = x*y, xz = x*z, yz = y*z;
+    GLfloat wx = w*x, wy = w*y, wz = w*z;
+
+    // Rotation columns scaled by per axis scale
+#if defined(TRANSFORM_SSE)
+    _mm_storeu_ps(out + 0, _mm_mul_ps(_mm_setr_ps(1.0f - 2.0f*(yy + zz), 2.0f*(xy + wz), 2.0f*(xz - wy), 0.0f), _mm_set1_ps(s[0])));
+    _mm_storeu_ps(out + 4, _mm_mul_ps(_mm_setr_ps(2.0f*(xy - wz), 1.0f - 2.0f*(xx + zz), 2.0f*(yz + wx), 0.0f), _mm_set1_ps(s[1])));
+    _mm_storeu_ps(out + 8, _mm_mul_ps(_mm_setr_ps(2.0f*(xz + wy), 2.0f*(yz - wx), 1.0f - 2.0f*(xx + yy), 0.0f), _mm_set1_ps(s[2])));
+    _mm_storeu_ps(out + 12, _mm_setr_ps(t[0], t[1], t[2], 1.0f));
+#else
+    GLfloat r[12] = {1.0f - 2.0f*(yy + zz), 2.0f*(xy + wz), 2.0f*(xz - wy), 0.0f,
+                     2.0f*(xy - wz), 1.0f - 2.0f*(xx + zz), 2.0f*(yz + wx), 0.0f,
+                     2.0f*(xz + wy), 2.0f*(yz - wx), 1.0f - 2.0f*(xx + yy), 0.0f};
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 4; i++) {
+            out[4*c + i] = r[4*c + i]*s[c];
+        }
+    }
+    out[12] = t[0];
+    out[13] = t[1];
+    out[14] = t[2];
+    out[15] = 1.0f;
+#endif
+}
+
+#if defined(TRANSFORM_SSE)
+// Cross product of xyz lanes (w lane is zero)
+static inline __m128 cross_ps(__m128 a, __m128 b) {
+    __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// Dot product of xyz lanes broadcast to all lanes
+static inline __m128 dot3_ps(__m128 a, __m128 b) {
+    __m128 p = _mm_mul_ps(a, b);
+    __m128 x = _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 z = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2));
+    return _mm_add_ps(_mm_add_ps(x, y), z);
+}
+
+// Upper 3x3 columns with w lane cleared
+static inline void load_basis(const GLfloat m[16], __m128 c[3]) {
+    const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    for (int i = 0; i < 3; i++) {
+        c[i] = _mm_and_ps(_mm_loadu_ps(m + 4*i), mask);
+    }
+}
+#elif defined(TRANSFORM_NEON)
+static inline float32x4_t cross_ps(float32x4_t a, float32x4_t b) {
+    // Rotate lanes to (y, z, x, w)
+    float32x4_t a_yzx = vcombine_f32(vext_f32(vget_low_f32(a), vget_high_f32(a), 1), vget_low_f32(a));
+    float32x4_t b_yzx = vcombine_f32(vext_f32(vget_low_f32(b), vget_high_f32(b), 1), vget_low_f32(b));
+    float32x4_t c = vsubq_f32(vmulq_f32(a, b_yzx), vmulq_f32(a_yzx, b));
+    float32x4_t r = vcombine_f32(vext_f32(vget_low_f32(c), vget_high_f32(c), 1), vget_low_f32(c));
+    return vsetq_lane_f32(0.0f, r, 3);
+}
+
+static inline float dot3_ps(float32x4_t a, float32x4_t b) {
+    float32x4_t p = vmulq_f32(a, b);
+    return vgetq_lane_f32(p, 0) + vgetq_lane_f32(p, 1) + vgetq_lane_f32(p, 2);
+}
+
+static inline void load_basis(const GLfloat m[16], float32x4_t c[3]) {
+    for (int i = 0; i < 3; i++) {
+        c[i] = vsetq_lane_f32(0.0f, vld1q_f32(m + 4*i), 3);
+    }
+}
+#else
+static inline void cross3(const GLfloat *a, const GLfloat *b, GLfloat *r) {
+    r[0] = a[1]*b[2] - a[2]*b[1];
+    r[1] = a[2]*b[0] - a[0]*b[2];
+    r[2] = a[0]*b[1] - a[1]*b[0];
+}
+#endif
+
+void mul_affine(const GLfloat a[16], const GLfloat b[16], GLfloat out[16]) {
+#if defined(TRANSFORM_SSE)
+    __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+    for (int j = 0; j < 4; j++) {
+        const GLfloat *bj = b + 4*j;
+        __m128 r = _mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(bj[0])), _mm_mul_ps(a1, _mm_set1_ps(bj[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bj[2])));
+        // Columns 0-2 of affine b have w = 0, column 3 has w = 1
+        if (j == 3) {
+            r = _mm_add_ps(r, a3);
+        }
+        _mm_storeu_ps(out + 4*j, r);
+    }
+#elif defined(TRANSFORM_NEON)
+    float32x4_t a0 = vld1q_f32(a), a1 = vld1q_f32(a + 4), a2 = vld1q_f32(a + 8), a3 = vld1q_f32(a + 12);
+    for (int j = 0; j < 4; j++) {
+        const GLfloat *bj = b + 4*j;
+        float32x4_t r = vmulq_n_f32(a0, bj[0]);
+        r = vmlaq_n_f32(r, a1, bj[1]);
+        r = vmlaq_n_f32(r, a2, bj[2]);
+        if (j == 3) {
+            r = vaddq_f32(r, a3);
+        }
+        vst1q_f32(out + 4*j, r);
+    }
+#else
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 4; i++) {
+            GLfloat v = a[i]*b[4*j] + a[4 + i]*b[4*j + 1] + a[8 + i]*b[4*j + 2];
+            out[4*j + i] = j == 3 ? v + a[12 + i] : v;
+        }
+    }
+#endif
+}
+
+bool affine_inverse(const GLfloat m[16], GLfloat out[16]) {
+    // Rows of inverse 3x3 are cross products of columns divided by determinant
+#if defined(TRANSFORM_SSE)
+    __m128 c[3];
+    load_basis(m, c);
+    __m128 r0 = cross_ps(c[1], c[2]);
+    __m128 r1 = cross_ps(c[2], c[0]);
+    __m128 r2 = cross_ps(c[0], c[1]);
+    __m128 det = dot3_ps(c[0], r0);
+    if (_mm_cvtss_f32(det) == 0.0f) {
+        return false;
+    }
+    __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    r0 = _mm_mul_ps(r0, inv_det);
+    r1 = _mm_mul_ps(r1, inv_det);
+    r2 = _mm_mul_ps(r2, inv_det);
+
+    // Translation -inv(A)*t goes in w lane of each row, so a transpose yields the columns
+    __m128 t = _mm_loadu_ps(m + 12);
+    __m128 tx = _mm_sub_ps(_mm_setzero_ps(), dot3_ps(r0, t));
+    __m128 ty = _mm_sub_ps(_mm_setzero_ps(), dot3_ps(r1, t));
+    __m128 tz = _mm_sub_ps(_mm_setzero_ps(), dot3_ps(r2, t));
+    const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    const __m128 wlane = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+    r0 = _mm_or_ps(_mm_and_ps(r0, mask), _mm_and_ps(tx, wlane));
+    r1 = _mm_or_ps(_mm_and_ps(r1, mask), _mm_and_ps(ty, wlane));
+    r2 = _mm_or_ps(_mm_and_ps(r2, mask), _mm_and_ps(tz, wlane));
+    __m128 r3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(out, r0);
+    _mm_storeu_ps(out + 4, r1);
+    _mm_storeu_ps(out + 8, r2);
+    _mm_storeu_ps(out + 12, r3);
+#elif defined(TRANSFORM_NEON)
+    float32x4_t c[3];
+    load_basis(m, c);
+    float32x4_t r[3] = {cross_ps(c[1], c[2]), cross_ps(c[2], c[0]), cross_ps(c[0], c[1])};
+    float det = dot3_ps(c[0], r[0]);
+    if (det == 0.0f) {
+        return false;
+    }
+    float32x4_t t = vsetq_lane_f32(0.0f, vld1q_f32(m + 12), 3);
+    GLfloat rows[3][4];
+    for (int i = 0; i < 3; i++) {
+        r[i] = vmulq_n_f32(r[i], 1.0f/det);
+        vst1q_f32(rows[i], r[i]);
+        rows[i][3] = -dot3_ps(r[i], t);
+    }
+    for (int j = 0; j < 4; j++) {
+        out[4*j] = rows[0][j];
+        out[4*j + 1] = rows[1][j];
+        out[4*j + 2] = rows[2][j];
+        out[4*j + 3] = j == 3 ? 1.0f : 0.0f;
+    }
+#else
+    GLfloat r[3][3];
+    cross3(m + 4, m + 8, r[0]);
+    cross3(m + 8, m, r[1]);
+    cross3(m, m + 4, r[2]);
+    GLfloat det = m[0]*r[0][0] + m[1]*r[0][1] + m[2]*r[0][2];
+    if (det == 0.0f) {
+        return false;
+    }
+    GLfloat inv_det = 1.0f/det;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            out[4*j + i] = r[i][j]*inv_det;
+        }
+        out[12 + i] = -(out[i]*m[12] + out[4 + i]*m[13] + out[8 + i]*m[14]);
+        out[4*i + 3] = 0.0f;
+    }
+    out[15] = 1.0f;
+#endif
+    return true;
+}
+
+void normal_matrix_of(const GLfloat m[16], GLfloat out[16]) {
+    // Cofactor columns keep outward normals for mirroring transforms when flipped by sign of determinant
+#if defined(TRANSFORM_SSE)
+    __m128 c[3];
+    load_basis(m, c);
+    __m128 n0 = cross_ps(c[1], c[2]);
+    __m128 n1 = cross_ps(c[2], c[0]);
+    __m128 n2 = cross_ps(c[0], c[1]);
+    if (_mm_cvtss_f32(dot3_ps(c[0], n0)) < 0.0f) {
+        __m128 sign = _mm_set1_ps(-0.0f);
+        n0 = _mm_xor_ps(n0, sign);
+        n1 = _mm_xor_ps(n1, sign);
+        n2 = _mm_xor_ps(n2, sign);
+    }
+    _mm_storeu_ps(out, n0);
+    _mm_storeu_ps(out + 4, n1);
+    _mm_storeu_ps(out + 8, n2);
+    _mm_storeu_ps(out + 12, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+#elif defined(TRANSFORM_NEON)
+    float32x4_t c[3];
+    load_basis(m, c);
+    float32x4_t n[3] = {cross_ps(c[1], c[2]), cross_ps(c[2], c[0]), cross_ps(c[0], c[1])};
+    float sign = dot3_ps(c[0], n[0]) < 0.0f ? -1.0f : 1.0f;
+    for (int i = 0; i < 3; i++) {
+        vst1q_f32(out + 4*i, vmulq_n_f32(n[i], sign));
+    }
+    out[12] = out[13] = out[14] = 0.0f;
+    out[15] = 1.0f;
+#else
+    cross3(m + 4, m + 8, out);
+    cross3(m + 8, m, out + 4);
+    cross3(m, m + 4, out + 8);
+    GLfloat sign = m[0]*out[0] + m[1]*out[1] + m[2]*out[2] < 0.0f ? -1.0f : 1.0f;
+    for (int i = 0; i < 12; i++) {
+        out[i] = (i & 3) == 3 ? 0.0f : out[i]*sign;
+    }
+    out[12] = out[13] = out[14] = 0.0f;
+    out[15] = 1.0f;
+#endif
+}
+
+mat4 compose_trs(const vec3 &t, const vec4 &q, const vec3 &s) {
+    mat4 m;
+    const GLfloat *tp = t;
+    const GLfloat *qp = q;
+    const GLfloat *sp = s;
+    compose_trs(tp, qp, sp, (GLfloat *)m);
+    return m;
+}
+
+mat4 normal_matrix_of(const mat4 &m) {
+    mat4 n;
+    normal_matrix_of((const GLfloat *)m, (GLfloat *)n);
+    return n;
+}
@@ -0,0 +1,33 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "../common/vgl.h"
+#include "../common/vmath.h"
+
+// Affine transform kernels (SSE/NEON with scalar fallback) on column major 4x4 matrices.
+// Matrices are assumed affine (last row 0, 0, 0, 1) as built by translate/rotate/scale.
+
+// Unit quaternion (x, y, z, w) for rotation of angle degrees about axis (normalized here)
+vmath::vec4 axis_angle(GLfloat angle, const vmath::vec3 &axis);
+
+// translate(t)*rotate(q)*scale(s) built directly without matrix products
+void compose_trs(const GLfloat t[3], const GLfloat q[4], const GLfloat s[3], GLfloat out[16]);
+
+// a*b for affine matrices (out may alias neither input)
+void mul_affine(const GLfloat a[16], const GLfloat b[16], GLfloat out[16]);
+
+// Inverse of affine matrix (returns false and leaves out untouched if singular)
+bool affine_inverse(const GLfloat m[16], GLfloat out[16]);
+
+// Normal matrix as cofactor matrix of upper 3x3 (inverse transpose up to positive scale). Needs no
+// division, so flattened objects with a zero scale still get normals along their collapsed axis.
+void normal_matrix_of(const GLfloat m[16], GLfloat out[16]);
+
+// vmath wrappers
+vmath::mat4 compose_trs(const vmath::vec3 &t, const vmath::vec4 &q, const vmath::vec3 &s);
+vmath::mat4 normal_matrix_of(const vmath::mat4 &m);
+
+#endif
@@ -0,0 +1,71 @@
+// CS370 Final Project
+// Fall 2023
+// Transform microbenchmark: transform_bench [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "transform.h"
+
+using namespace vmath;
+using namespace std;
+
+// Keeps results live so the compiler cannot drop the loops
+static volatile GLfloat sink;
+
+int main(int argc, char**argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: transform_bench [iterations]\n");
+        return 1;
+    }
+
+    // vmath path: three matrix products plus general inverse and transpose
+    GLfloat acc = 0.0f;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        GLfloat a = (GLfloat)(i & 1023);
+        mat4 model_matrix = translate(a, 3.1f, 0.0f)*rotate(a, 0.0f, 1.0f, 0.0f)*scale(2.65f, 0.05f, 0.4f);
+        mat4 normal_matrix = model_matrix.inverse().transpose();
+        acc += model_matrix[3][0] + normal_matrix[0][0];
+    }
+    double vmath_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/iterations;
+    sink = acc;
+
+    // Fused TRS and cofactor normal matrix
+    acc = 0.0f;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        GLfloat a = (GLfloat)(i & 1023);
+        mat4 model_matrix = compose_trs(vec3(a, 3.1f, 0.0f), axis_angle(a, vec3(0.0f, 1.0f, 0.0f)), vec3(2.65f, 0.05f, 0.4f));
+        mat4 normal_matrix = normal_matrix_of(model_matrix);
+        acc += model_matrix[3][0] + normal_matrix[0][0];
+    }
+    double fused_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/iterations;
+    sink = acc;
+
+    // Affine inverse against general inverse
+    mat4 m = compose_trs(vec3(1.0f, 2.0f, 3.0f), axis_angle(30.0f, vec3(1.0f, 1.0f, 0.0f)), vec3(2.0f, 0.5f, 1.0f));
+    acc = 0.0f;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        m[3][0] = (GLfloat)(i & 1023);
+        acc += m.inverse()[3][1];
+    }
+    double inverse_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/iterations;
+    acc = 0.0f;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        mat4 inv;
+        m[3][0] = (GLfloat)(i & 1023);
+        affine_inverse((const GLfloat *)m, (GLfloat *)inv);
+        acc += inv[3][1];
+    }
+    double affine_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/iterations;
+    sink = acc;
+
+    printf("model + normal matrix: vmath %.1f ns, fused %.1f ns (%.2fx)\n", vmath_ns, fused_ns, vmath_ns/fused_ns);
+    printf("inverse: vmath %.1f ns, affine %.1f ns (%.2fx)\n", inverse_ns, affine_ns, inverse_ns/affine_ns);
+    return 0;
+}
@@ -0,0 +1,106 @@
+// CS370 Final Project
+// Fall 2023
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include "thread_pool.h"
+#include "transform.h"
+#include "transform_store.h"
+
+using namespace vmath;
+using namespace std;
+
+static bool same(const GLfloat *a, const GLfloat *b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+GLuint TransformStore::add(const vec3 &position, const vec4 &rotation, const vec3 &scale, GLint parent) {
+    GLuint id = size();
+    if (parent >= (GLint)id) {
+        fprintf(stderr, "ERROR: transform parent %d added after child %u\n", parent, id);
+        parent = NoParent;
+    }
+    positions.push_back(position);
+    rotations.push_back(rotation);
+    scales.push_back(scale);
+    worlds.push_back(mat4().identity());
+    normals.push_back(mat4().identity());
+    parents.push_back(parent);
+    dirty.push_back(1);
+    stamps.push_back(0);
+    GLuint depth = parent == NoParent ? 0 : depths[parent] + 1;
+    depths.push_back(depth);
+    if (depth >= levels.size()) {
+        levels.resize(depth + 1);
+    }
+    levels[depth].push_back(id);
+    return id;
+}
+
+void TransformStore::set_position(GLuint id, const vec3 &position) {
+    if (!same(positions[id], position, 3)) {
+        positions[id] = position;
+        dirty[id] = 1;
+    }
+}
+
+void TransformStore::set_rotation(GLuint id, const vec4 &rotation) {
+    if (!same(rotations[id], rotation, 4)) {
+        rotations[id] = rotation;
+        dirty[id] = 1;
+    }
+}
+
+void TransformStore::set_scale(GLuint id, const vec3 &scale) {
+    if (!same(scales[id], scale, 3)) {
+        scales[id] = scale;
+        dirty[id] = 1;
+    }
+}
+
+bool TransformStore::update_entry(GLuint i) {
+    // Parent is on a shallower level, so its flag and matrix are final by now
+    GLint p = parents[i];
+    if (p != NoParent) {
+        dirty[i] |= dirty[p];
+    }
+    if (!dirty[i]) {
+        return false;
+    }
+    GLfloat *world = (GLfloat *)worlds.data();
+    GLfloat *m = world + 16*i;
+    if (p == NoParent) {
+        compose_trs(positions[i], rotations[i], scales[i], m);
+    } else {
+        GLfloat local[16];
+        compose_trs(positions[i], rotations[i], scales[i], local);
+        mul_affine(world + 16*p, local, m);
+    }
+    normal_matrix_of(m, (GLfloat *)normals.data() + 16*i);
+    stamps[i] = sweeps;
+    return true;
+}
+
+GLuint TransformStore::update(ThreadPool *pool) {
+    atomic<GLuint> updated(0);
+    sweeps++;
+
+    for (size_t d = 0; d < levels.size(); d++) {
+        const vector<GLuint> &level = levels[d];
+        parallel_for(pool, level.size(), [&](size_t begin, size_t end) {
+            GLuint count = 0;
+            for (size_t k = begin; k < end; k++) {
+                count += update_entry(level[k]) ? 1 : 0;
+            }
+            updated += count;
+        });
+    }
+    memset(dirty.data(), 0, size());
+    return updated;
+}
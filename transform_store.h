@@ -0,0 +1,62 @@
+// CS370 Final Project
+// Fall 2023
+
+#ifndef TRANSFORM_STORE_H
+#define TRANSFORM_STORE_H
+
+#include <vector>
+#include "../common/vgl.h"
+#include "../common/vmath.h"
+
+// Parent index of root transforms
+const GLint NoParent = -1;
+
+// Identity rotation quaternion
+const vmath::vec4 NoRotation = vmath::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+// Transform components in structure of arrays layout. Local position, rotation (unit quaternion)
+// and scale are edited through setters that mark entries dirty; update() rebuilds world and
+// normal matrices of dirty entries and their descendants. Entries are grouped by hierarchy
+// depth and swept one depth at a time in index order, so every entry of a level only reads
+// finished parents and a level can be split across pool workers.
+class ThreadPool;
+
+class TransformStore {
+public:
+    TransformStore() : sweeps(0) {}
+
+    // Add a transform (parent must already exist) and return its index
+    GLuint add(const vmath::vec3 &position, const vmath::vec4 &rotation, const vmath::vec3 &scale, GLint parent = NoParent);
+
+    // Setters only dirty an entry when the value changes
+    void set_position(GLuint id, const vmath::vec3 &position);
+    void set_rotation(GLuint id, const vmath::vec4 &rotation);
+    void set_scale(GLuint id, const vmath::vec3 &scale);
+
+    const vmath::mat4 &world(GLuint id) const { return worlds[id]; }
+    const vmath::mat4 &normal(GLuint id) const { return normals[id]; }
+    GLint parent(GLuint id) const { return parents[id]; }
+    GLuint size() const { return (GLuint)parents.size(); }
+    // Matrices were rebuilt by the most recent update()
+    bool moved(GLuint id) const { return stamps[id] == sweeps; }
+
+    // Rebuild matrices of dirty entries, spread over pool workers when given (returns number of entries updated)
+    GLuint update(ThreadPool *pool = NULL);
+
+private:
+    bool update_entry(GLuint i);
+
+    std::vector<vmath::vec3> positions;
+    std::vector<vmath::vec4> rotations;
+    std::vector<vmath::vec3> scales;
+    std::vector<vmath::mat4> worlds;
+    std::vector<vmath::mat4> normals;
+    std::vector<GLint> parents;
+    std::vector<GLubyte> dirty;
+    std::vector<GLuint> stamps;     // sweep that last rebuilt each entry
+    std::vector<GLuint> depths;
+    std::vector<std::vector<GLuint> > levels;   // entries of each depth in index order
+    GLuint sweeps;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#version 400 core
+
+// Bilinear upscale with unsharp mask against neighbouring texels of the scaled render
+in vec2 TexCoords;
+out vec4 FragColor;
+
+uniform sampler2D sceneMap;
+uniform vec2 UvScale;
+uniform vec2 TexelSize;
+uniform float Sharpness;
+
+// Sample clamped to rendered part of target
+vec3 scene(vec2 uv)
+{
+    return texture(sceneMap, clamp(uv, 0.5*TexelSize, UvScale - 0.5*TexelSize)).rgb;
+}
+
+void main()
+{
+    vec3 center = scene(TexCoords);
+    vec3 around = scene(TexCoords + vec2(TexelSize.x, 0.0)) + scene(TexCoords - vec2(TexelSize.x, 0.0)) +
+                  scene(TexCoords + vec2(0.0, TexelSize.y)) + scene(TexCoords - vec2(0.0, TexelSize.y));
+    vec3 color = center + Sharpness*(center - 0.25*around);
+    FragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
@@ -0,0 +1,13 @@
+#version 400 core
+
+// Full screen triangle from vertex index, texture coordinates over rendered part of target
+out vec2 TexCoords;
+
+uniform vec2 UvScale;
+
+void main( )
+{
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoords = pos*UvScale;
+    gl_Position = vec4(pos*2.0 - 1.0, 0.0, 1.0);
+}
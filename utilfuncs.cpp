@@ -8,84 +8,237 @@ void build_solid_color_buffer(GLuint num_vertices, vec4 color, GLuint buffer) {
         obj_colors.push_back(color);
     }
 
-    glBindBuffer(GL_ARRAY_BUFFER, ColorBuffers[buffer]);
+    state_bind_buffer(GL_ARRAY_BUFFER, ColorBuffers[buffer]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*colCoords*num_vertices, obj_colors.data(), GL_STATIC_DRAW);
 }
 
 void load_model(const char * filename, GLuint obj) {
-    vector<vec4> vertices;
-    vector<vec2> uvCoords;
-    vector<vec3> normals;
-
-    // Load model and set number of vertices
-    loadOBJ(filename, vertices, uvCoords, normals);
-    numVertices[obj] = vertices.size();
+    MappedMesh mesh;
+
+    // Map welded, indexed mesh from binary cache (rebuilt from OBJ when stale)
+    if (!open_mesh_cache(filename, hasTangents[obj], mesh, worker_pool)) {
+        numVertices[obj] = 0;
+        numIndices[obj] = 0;
+        numLods[obj] = 0;
+        return;
+    }
+    numVertices[obj] = mesh.numVertices;
+    numIndices[obj] = mesh.numIndices;
+    numLods[obj] = mesh.numLods;
+    for (GLuint l = 0; l < mesh.numLods; l++) {
+        lodOffset[obj][l] = mesh.lodOffset[l];
+        lodCount[obj][l] = mesh.lodCount[l];
+    }
+    boundingSphere[obj] = vec4(mesh.bounds[0], mesh.bounds[1], mesh.bounds[2], mesh.bounds[3]);
+    boundingBox[obj][0] = vec3(mesh.box[0], mesh.box[1], mesh.box[2]);
+    boundingBox[obj][1] = vec3(mesh.box[3], mesh.box[4], mesh.box[5]);
 
-    // Create and load object buffers
+    // Create and load object buffers directly from mapped streams
     glGenBuffers(NumObjBuffers, ObjBuffers[obj]);
-    glBindVertexArray(VAOs[obj]);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*posCoords*numVertices[obj], vertices.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*normCoords*numVertices[obj], normals.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TexBuffer]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*texCoords*numVertices[obj], uvCoords.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    state_bind_vertex_array(VAOs[obj]);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*posCoords*numVertices[obj], mesh.positions, GL_STATIC_DRAW);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*normCoords*numVertices[obj], mesh.normals, GL_STATIC_DRAW);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TexBuffer]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*texCoords*numVertices[obj], mesh.uvCoords, GL_STATIC_DRAW);
+    // Tangents only for objects bump mapped with vertex tangent frames
+    if (hasTangents[obj]) {
+        state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TangBuffer]);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*tangCoords*numVertices[obj], mesh.tangents, GL_STATIC_DRAW);
+    }
+    state_bind_buffer(GL_ARRAY_BUFFER, 0);
+    // Index buffer binding is stored in vertex array
+    state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ObjBuffers[obj][IndexBuffer]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)*numIndices[obj], mesh.indices, GL_STATIC_DRAW);
+    state_bind_vertex_array(0);
+
+    close_mesh_cache(mesh);
 }
 
-void load_texture(const char * filename, GLuint texID, GLint magFilter, GLint minFilter, GLint sWrap, GLint tWrap, bool mipMap, bool invert) {
-    int w, h, n;
-    int force_channels = 4;
-    unsigned char *image_data;
+// Object space bounding box and sphere (around box center) of generated geometry
+void compute_bounds(const vector<vec4> &vertices, GLuint obj) {
+    vec3 lo = vec3(vertices[0][0], vertices[0][1], vertices[0][2]);
+    vec3 hi = lo;
+    for (size_t i = 1; i < vertices.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            lo[k] = vertices[i][k] < lo[k] ? vertices[i][k] : lo[k];
+            hi[k] = vertices[i][k] > hi[k] ? vertices[i][k] : hi[k];
+        }
+    }
+    vec3 center = (lo + hi)*0.5f;
+    GLfloat radius = 0.0f;
+    for (size_t i = 0; i < vertices.size(); i++) {
+        GLfloat d = length(vec3(vertices[i][0], vertices[i][1], vertices[i][2]) - center);
+        radius = d > radius ? d : radius;
+    }
+    boundingBox[obj][0] = lo;
+    boundingBox[obj][1] = hi;
+    boundingSphere[obj] = vec4(center[0], center[1], center[2], radius);
+}
 
-    // Activate unit 0
-    glActiveTexture( GL_TEXTURE0 );
-
-    image_data = stbi_load(filename, &w, &h, &n, force_channels);
-    if (!image_data) {
-        fprintf(stderr, "ERROR: could not load %s\n", filename);
-    }
-    // NPOT check for power of 2 dimensions
-    if ((w & (w - 1)) != 0 || (h & (h - 1)) != 0) {
-        fprintf(stderr, "WARNING: texture %s is not power-of-2 dimensions\n", filename);
-    }
-    
-    // Invert image (e.g. jpeg, png)
-    if (invert) {
-        int width_in_bytes = w * 4;
-        unsigned char *top = NULL;
-        unsigned char *bottom = NULL;
-        unsigned char temp = 0;
-        int half_height = h / 2;
-
-        for ( int row = 0; row < half_height; row++ ) {
-            top = image_data + row * width_in_bytes;
-            bottom = image_data + ( h - row - 1 ) * width_in_bytes;
-            for ( int col = 0; col < width_in_bytes; col++ ) {
-                temp = *top;
-                *top = *bottom;
-                *bottom = temp;
-                top++;
-                bottom++;
+// Load cooked texture or decode source image (safe to call from worker threads)
+static void decode_texture(const TextureRequest &req, Image &image) {
+    // BC4/BC5 (RGTC) are core, BC1/BC3 need S3TC support
+    bool cooked = req.role != AlbedoMap || GLEW_EXT_texture_compression_s3tc;
+
+    // Prefer prebuilt compressed mip chain over decoding source image
+    bool loaded = cooked && cooked_is_current(req.filename) &&
+                  read_cooked_texture(cooked_path(req.filename).c_str(), image);
+    if (!loaded) {
+        // Store only channels used by texture role
+        GLint channels = req.role == NormalMap ? 2 : req.role == MaskMap ? 1 : albedo_channels(req.filename);
+        decode_image(req.filename, image, channels, req.invert, req.mipMap);
+    }
+}
+
+// Register textures to be loaded when first bound
+void register_textures(const TextureRequest *requests, GLuint count) {
+    for (GLuint i = 0; i < count; i++) {
+        TextureStream &stream = TextureStreams[requests[i].texID];
+        stream.req = requests[i];
+        stream.state = TexRegistered;
+    }
+}
+
+// Release CPU copy of streamed texture (pixels now live in staging buffers)
+static void release_texture_image(TextureStream &stream) {
+    stream.image.levels.clear();
+    stream.image.levels.shrink_to_fit();
+}
+
+// Upload next (finer) mip level of streaming texture and expose it to sampling
+static void stream_texture_level(TextureStream &stream) {
+    upload_texture_level(stream.req, stream.image, stream.nextLevel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, stream.nextLevel);
+    stream.nextLevel--;
+    if (stream.nextLevel < 0) {
+        release_texture_image(stream);
+        stream.state = TexResident;
+    }
+}
+
+// Load texture immediately on calling (GL) thread
+void load_texture(GLuint texture) {
+    TextureStream &stream = TextureStreams[texture];
+    decode_texture(stream.req, stream.image);
+    if (stream.image.levels.empty()) {
+        stream.state = TexFailed;
+        return;
+    }
+    allocate_texture(stream.req, stream.image);
+    stream.nextLevel = stream.image.levels.size() - 1;
+    stream.state = TexStreaming;
+    while (stream.state == TexStreaming) {
+        stream_texture_level(stream);
+    }
+}
+
+// Start decoding registered texture on a worker thread
+void request_texture(GLuint texture) {
+    TextureStream &stream = TextureStreams[texture];
+    if (stream.state != TexRegistered) {
+        return;
+    }
+    stream.state = TexDecoding;
+    worker_pool->submit_background([texture]() {
+        decode_texture(TextureStreams[texture].req, TextureStreams[texture].image);
+        decodedTextures.push(texture);
+    });
+}
+
+// Bind texture to active unit, falling back to blank (or flat normal) texture until it has data
+void bind_texture(GLuint texture) {
+    const TextureStream &stream = TextureStreams[texture];
+    if (stream.state == TexRegistered) {
+        request_texture(texture);
+    } else if (stream.state == TexUnregistered || stream.state == TexStreaming || stream.state == TexResident) {
+        state_bind_texture(GL_TEXTURE_2D, TextureIDs[texture]);
+        return;
+    }
+    state_bind_texture(GL_TEXTURE_2D, TextureIDs[stream.req.role == NormalMap ? FlatNorm : Blank]);
+}
+
+// Allocate decoded textures and upload mip levels coarse to fine within per frame budget
+void stream_textures() {
+    GLuint texture;
+    while (decodedTextures.try_pop(texture)) {
+        TextureStream &stream = TextureStreams[texture];
+        if (stream.image.levels.empty()) {
+            stream.state = TexFailed;
+            continue;
+        }
+        allocate_texture(stream.req, stream.image);
+        stream.nextLevel = stream.image.levels.size() - 1;
+        stream.state = TexStreaming;
+        // Coarsest level always goes up at once so texture is complete when first sampled
+        stream_texture_level(stream);
+    }
+
+    // Smallest pending level across all textures first so every texture sharpens evenly
+    size_t uploaded = 0;
+    while (uploaded < TextureUploadBudget) {
+        TextureStream *next = NULL;
+        for (GLuint t = 0; t < NumTextures; t++) {
+            TextureStream &stream = TextureStreams[t];
+            if (stream.state == TexStreaming && (!next ||
+                stream.image.levels[stream.nextLevel].pixels.size() < next->image.levels[next->nextLevel].pixels.size())) {
+                next = &stream;
             }
         }
-	}
+        if (!next) {
+            break;
+        }
+        uploaded += next->image.levels[next->nextLevel].pixels.size();
+        stream_texture_level(*next);
+    }
+}
+
+// No requested texture still decoding or streaming levels
+bool textures_settled() {
+    for (GLuint t = 0; t < NumTextures; t++) {
+        if (TextureStreams[t].state == TexDecoding || TextureStreams[t].state == TexStreaming) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void allocate_texture(const TextureRequest &req, const Image &image) {
+    static const GLenum formats[] = {GL_NONE, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    bool compressed = is_compressed_format(image.format);
+    GLsizei levels = image.levels.size();
+
+    // Activate unit 0
+    state_active_texture( GL_TEXTURE0 );
 
     // Bind current texture id
-    glBindTexture(GL_TEXTURE_2D, TextureIDs[texID]);
-    // Load image data into texture
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE,
-                 image_data);
-    // Generate mipmaps for texture
-    if (mipMap) {
-        glGenerateMipmap(GL_TEXTURE_2D);
+    state_bind_texture(GL_TEXTURE_2D, TextureIDs[req.texID]);
+
+    // Allocate immutable storage for whole mip chain
+    if (GLEW_ARB_texture_storage) {
+        glTexStorage2D(GL_TEXTURE_2D, levels, image.format, image.levels[0].width, image.levels[0].height);
+    } else {
+        for (GLsizei level = 0; level < levels; level++) {
+            const ImageLevel &l = image.levels[level];
+            if (compressed) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, l.width, l.height, 0, l.pixels.size(), NULL);
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, level, image.format, l.width, l.height, 0, formats[image.channels],
+                             GL_UNSIGNED_BYTE, NULL);
+            }
+        }
     }
+
+    // Only sample levels uploaded so far (base level drops as finer levels arrive)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
     // Set scaling modes
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, req.magFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, req.minFilter);
     // Set wrapping modes
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sWrap);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, tWrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, req.sWrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, req.tWrap);
     // Set maximum anisotropic filtering for system
     GLfloat max_aniso = 0.0f;
     glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_aniso);
@@ -93,151 +246,295 @@ void load_texture(const char * filename, GLuint texID, GLint magFilter, GLint mi
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_aniso);
 }
 
+void upload_texture_level(const TextureRequest &req, const Image &image, GLint level) {
+    static const GLenum formats[] = {GL_NONE, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    bool compressed = is_compressed_format(image.format);
+    const ImageLevel &l = image.levels[level];
+
+    // Activate unit 0
+    state_active_texture( GL_TEXTURE0 );
+
+    // Bind current texture id
+    state_bind_texture(GL_TEXTURE_2D, TextureIDs[req.texID]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Stage level in a pixel buffer so transfer does not block on client memory
+    GLubyte *staged = begin_staging(l.pixels.size());
+    if (staged) {
+        memcpy(staged, l.pixels.data(), l.pixels.size());
+        end_staging();
+    } else {
+        // Mapping failed, source transfer from client memory instead
+        submit_staging();
+    }
+
+    // Issue transfer (offset into staging buffer, or client pointer)
+    const GLvoid *src = staged ? (const GLvoid *)0 : (const GLvoid *)l.pixels.data();
+    if (compressed) {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, l.width, l.height, image.format,
+                                  l.pixels.size(), src);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, l.width, l.height, formats[image.channels],
+                        GL_UNSIGNED_BYTE, src);
+    }
+    // Fence transfer so staging buffer is recycled once GPU has consumed it
+    if (staged) {
+        submit_staging();
+    }
+}
+
+// Pick level of detail from projected size of bounding sphere in pass view (safe on worker threads)
+GLint select_lod(GLuint obj, const mat4 &model, const PassView &view) {
+    if (numLods[obj] <= 1) {
+        return 0;
+    }
+    const mat4 &proj = view.proj;
+    mat4 model_view = view.camera*model;
+
+    // View space center and radius scaled by largest model axis
+    GLfloat center[3];
+    for (int r = 0; r < 3; r++) {
+        center[r] = model_view[0][r]*boundingSphere[obj][0] + model_view[1][r]*boundingSphere[obj][1] +
+                    model_view[2][r]*boundingSphere[obj][2] + model_view[3][r];
+    }
+    GLfloat max_scale = 0.0f;
+    for (int c = 0; c < 3; c++) {
+        GLfloat s = model_view[c][0]*model_view[c][0] + model_view[c][1]*model_view[c][1] + model_view[c][2]*model_view[c][2];
+        max_scale = s > max_scale ? s : max_scale;
+    }
+    GLfloat radius = boundingSphere[obj][3]*sqrt(max_scale);
+
+    // Camera inside or touching sphere always gets full detail
+    GLfloat depth = -center[2];
+    if (depth <= radius) {
+        return 0;
+    }
+    GLfloat size = proj[1][1]*radius/depth;
+    size *= view.lodBias;
+
+    GLint lod = 0;
+    while (lod + 1 < numLods[obj] && size < LodScreenSize[lod]) {
+        lod++;
+    }
+    return lod;
+}
+
+// Draw object triangles (indexed if object has an index buffer)
+void draw_triangles(GLuint obj) {
+    if (numIndices[obj] > 0) {
+        // Level picked when the draw packet was built
+        GLint lod = packetLod < numLods[obj] ? packetLod : 0;
+        glDrawElements(GL_TRIANGLES, lodCount[obj][lod], GL_UNSIGNED_INT, (const GLvoid *)(sizeof(GLuint)*lodOffset[obj][lod]));
+    } else {
+        glDrawArrays(GL_TRIANGLES, 0, numVertices[obj]);
+    }
+}
+
 // Draw object with color
 void draw_color_obj(GLuint obj, GLuint color) {
     // Select default shader program
-    glUseProgram(default_program);
+    state_use_program(default_program.id);
 
     // Pass projection matrix to default shader
-    glUniformMatrix4fv(default_proj_mat_loc, 1, GL_FALSE, proj_matrix);
+    set_uniform(default_program, UniProjMatrix, proj_matrix);
 
     // Pass camera matrix to default shader
-    glUniformMatrix4fv(default_cam_mat_loc, 1, GL_FALSE, camera_matrix);
+    set_uniform(default_program, UniCameraMatrix, camera_matrix);
 
     // Pass model matrix to default shader
-    glUniformMatrix4fv(default_model_mat_loc, 1, GL_FALSE, model_matrix);
+    set_uniform(default_program, UniModelMatrix, model_matrix);
 
     // Bind vertex array
-    glBindVertexArray(VAOs[obj]);
+    state_bind_vertex_array(VAOs[obj]);
 
     // Bind position object buffer and set attributes for default shader
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
-    glVertexAttribPointer(default_vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(default_vPos);
+    GLint vPos = program_attrib(default_program, AttrPosition);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
+    glVertexAttribPointer(vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(vPos);
 
     // Bind color buffer and set attributes for default shader
-    glBindBuffer(GL_ARRAY_BUFFER, ColorBuffers[color]);
-    glVertexAttribPointer(default_vCol, colCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(default_vCol);
+    GLint vCol = program_attrib(default_program, AttrColor);
+    state_bind_buffer(GL_ARRAY_BUFFER, ColorBuffers[color]);
+    glVertexAttribPointer(vCol, colCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(vCol);
 
     // Draw object
-    glDrawArrays(GL_TRIANGLES, 0, numVertices[obj]);
+    draw_triangles(obj);
 }
 
 void draw_mat_object(GLuint obj, GLuint material){
-    // Reference appropriate shader variables
+    // Reference appropriate shader program
+    ShaderProgram *prog;
     if (shadow) {
         // Use shadow shader
-        glUseProgram(shadow_program);
+        prog = &shadow_program;
+        state_use_program(prog->id);
         // Pass shadow projection and camera matrices to shader
-        glUniformMatrix4fv(shadow_proj_mat_loc, 1, GL_FALSE, shadow_proj_matrix);
-        glUniformMatrix4fv(shadow_camera_mat_loc, 1, GL_FALSE, shadow_camera_matrix);
-
-        // Set object attributes to shadow shader
-        vPos = shadow_vPos;
-        model_mat_loc = shadow_model_mat_loc;
+        set_uniform(*prog, UniLightProjMatrix, shadow_proj_matrix);
+        set_uniform(*prog, UniLightCamMatrix, shadow_camera_matrix);
     } else {
         // Use lighting shader with shadows
-        glUseProgram(phong_shadow_program);
+        prog = &phong_shadow_program;
+        state_use_program(prog->id);
 
         // Pass object projection and camera matrices to shader
-        glUniformMatrix4fv(phong_shadow_proj_mat_loc, 1, GL_FALSE, proj_matrix);
-        glUniformMatrix4fv(phong_shadow_camera_mat_loc, 1, GL_FALSE, camera_matrix);
+        set_uniform(*prog, UniProjMatrix, proj_matrix);
+        set_uniform(*prog, UniCameraMatrix, camera_matrix);
 
         // Bind lights
-        glUniformBlockBinding(phong_shadow_program, phong_shadow_lights_block_idx, 0);
-        glBindBufferRange(GL_UNIFORM_BUFFER, 0, LightBuffers[LightBuffer], 0, Lights.size() * sizeof(LightProperties));
+        state_bind_buffer_range(GL_UNIFORM_BUFFER, 0, LightBuffers[LightBuffer], 0, Lights.size() * sizeof(LightProperties));
 
         // Bind materials
-        glUniformBlockBinding(phong_shadow_program, phong_shadow_materials_block_idx, 1);
-        glBindBufferRange(GL_UNIFORM_BUFFER, 1, MaterialBuffers[MaterialBuffer], 0,
+        state_bind_buffer_range(GL_UNIFORM_BUFFER, 1, MaterialBuffers[MaterialBuffer], 0,
                           Materials.size() * sizeof(MaterialProperties));
 
         // Set camera position
-        glUniform3fv(phong_shadow_eye_loc, 1, eye);
+        set_uniform(*prog, UniEyePosition, eye);
 
         // Set num lights and lightOn
-        glUniform1i(phong_shadow_num_lights_loc, Lights.size());
-        glUniform1iv(phong_shadow_light_on_loc, numLights, lightOn);
+        set_uniform(*prog, UniNumLights, (GLint)Lights.size());
+        set_uniform(*prog, UniLightOn, lightOn, numLights);
 
         // Pass normal matrix to shader
-        glUniformMatrix4fv(phong_shadow_norm_mat_loc, 1, GL_FALSE, normal_matrix);
+        set_uniform(*prog, UniNormalMatrix, normal_matrix);
 
         // Pass material index to shader
-        glUniform1i(phong_shadow_material_loc, material);
+        set_uniform(*prog, UniMaterial, material);
 
-        glUniformMatrix4fv(phong_shadow_shad_proj_mat_loc, 1, GL_FALSE, shadow_proj_matrix);
-        glUniformMatrix4fv(phong_shadow_shad_cam_mat_loc, 1, GL_FALSE, shadow_camera_matrix);
+        set_uniform(*prog, UniLightProjMatrix, shadow_proj_matrix);
+        set_uniform(*prog, UniLightCamMatrix, shadow_camera_matrix);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, TextureIDs[ShadowTex]);
-
-        // Set object attributes for phong shadow shader
-        vPos = phong_shadow_vPos;
-        vNorm = phong_shadow_vNorm;
-        model_mat_loc = phong_shadow_model_mat_loc;
+        state_active_texture(GL_TEXTURE0);
+        state_bind_texture(GL_TEXTURE_2D, TextureIDs[ShadowTex]);
     }
 
     // Pass model matrix to shader
-    glUniformMatrix4fv(model_mat_loc, 1, GL_FALSE, model_matrix);
+    set_uniform(*prog, UniModelMatrix, model_matrix);
 
     // Bind vertex array
-    glBindVertexArray(VAOs[obj]);
+    state_bind_vertex_array(VAOs[obj]);
 
     // Bind position object buffer and set attributes
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
+    GLint vPos = program_attrib(*prog, AttrPosition);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
     glVertexAttribPointer(vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
     glEnableVertexAttribArray(vPos);
 
     if (!shadow) {
         // Bind object normal buffer if using phong shadow shader
-        glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
+        GLint vNorm = program_attrib(*prog, AttrNormal);
+        state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
         glVertexAttribPointer(vNorm, normCoords, GL_FLOAT, GL_FALSE, 0, NULL);
         glEnableVertexAttribArray(vNorm);
     }
 
     // Draw object
-    glDrawArrays(GL_TRIANGLES, 0, numVertices[obj]);
+    draw_triangles(obj);
+}
+
+// Cull opaque material objects on GPU and draw survivors with one indirect draw per mesh
+void draw_gpu_culled() {
+    run_gpu_cull(SceneObjects.size(), proj_matrix, camera_matrix, LodScreenSize);
+
+    // Lighting with shadows as in draw_mat_object (transforms and material per object)
+    ShaderProgram *prog = &phongShadowBatch_program;
+    state_use_program(prog->id);
+    set_uniform(*prog, UniProjMatrix, proj_matrix);
+    set_uniform(*prog, UniCameraMatrix, camera_matrix);
+    state_bind_buffer_range(GL_UNIFORM_BUFFER, 0, LightBuffers[LightBuffer], 0, Lights.size() * sizeof(LightProperties));
+    state_bind_buffer_range(GL_UNIFORM_BUFFER, 1, MaterialBuffers[MaterialBuffer], 0,
+                      Materials.size() * sizeof(MaterialProperties));
+    set_uniform(*prog, UniEyePosition, eye);
+    set_uniform(*prog, UniNumLights, (GLint)Lights.size());
+    set_uniform(*prog, UniLightOn, lightOn, numLights);
+    set_uniform(*prog, UniLightProjMatrix, shadow_proj_matrix);
+    set_uniform(*prog, UniLightCamMatrix, shadow_camera_matrix);
+    state_active_texture(GL_TEXTURE0);
+    state_bind_texture(GL_TEXTURE_2D, TextureIDs[ShadowTex]);
+
+    GLint vPos = program_attrib(*prog, AttrPosition);
+    GLint vNorm = program_attrib(*prog, AttrNormal);
+    GLint vObject = program_attrib(*prog, AttrObject);
+    for (GLuint obj = 0; obj < NumVAOs; obj++) {
+        if (batchDraws[obj] == 0) {
+            continue;
+        }
+        state_bind_vertex_array(VAOs[obj]);
+        state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
+        glVertexAttribPointer(vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(vPos);
+        state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][NormBuffer]);
+        glVertexAttribPointer(vNorm, normCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(vNorm);
+        bind_cull_ids(vObject);
+
+        draw_cull_batch(obj);
+
+        // Other programs drawing this vertex array do not read object indices
+        if (vObject >= 0) {
+            glVertexAttribDivisor(vObject, 0);
+            glDisableVertexAttribArray(vObject);
+        }
+    }
 }
 
 void draw_tex_object(GLuint obj, GLuint texture){
     // Select shader program
-    glUseProgram(texture_program);
+    state_use_program(texture_program.id);
 
     // Pass projection matrix to shader
-    glUniformMatrix4fv(texture_proj_mat_loc, 1, GL_FALSE, proj_matrix);
+    set_uniform(texture_program, UniProjMatrix, proj_matrix);
 
     // Pass camera matrix to shader
-    glUniformMatrix4fv(texture_camera_mat_loc, 1, GL_FALSE, camera_matrix);
+    set_uniform(texture_program, UniCameraMatrix, camera_matrix);
 
     // Pass model matrix to shader
-    glUniformMatrix4fv(texture_model_mat_loc, 1, GL_FALSE, model_matrix);
+    set_uniform(texture_program, UniModelMatrix, model_matrix);
 
-    // Bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, TextureIDs[texture]);
+    // Bind texture (blank until streamed in)
+    state_active_texture(GL_TEXTURE0);
+    bind_texture(texture);
 
     // Bind vertex array
-    glBindVertexArray(VAOs[obj]);
+    state_bind_vertex_array(VAOs[obj]);
 
     // Bind position object buffer and set attributes
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
-    glVertexAttribPointer(texture_vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(texture_vPos);
+    GLint vPos = program_attrib(texture_program, AttrPosition);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][PosBuffer]);
+    glVertexAttribPointer(vPos, posCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(vPos);
 
     // Bind texture object buffer and set attributes
-    glBindBuffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TexBuffer]);
-    glVertexAttribPointer(texture_vTex, texCoords, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(texture_vTex);
+    GLint vTex = program_attrib(texture_program, AttrTexCoord);
+    state_bind_buffer(GL_ARRAY_BUFFER, ObjBuffers[obj][TexBuffer]);
+    glVertexAttribPointer(vTex, texCoords, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(vTex);
 
     // Draw object
-    glDrawArrays(GL_TRIANGLES, 0, numVertices[obj]);
+    draw_triangles(obj);
 }
 
+// Render thread resizes viewport from next published step
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-    glViewport(0, 0, width, height);
+    sim.width = width;
+    sim.height = height;
+    request_frames();
+}
+
+// Stop drawing while minimized and redraw once restored
+void window_iconify_callback(GLFWwindow *window, int iconified) {
+    {
+        lock_guard<mutex> lock(snapshotMutex);
+        windowIconified = iconified != 0;
+    }
+    if (!iconified) {
+        request_frames();
+    }
+}
 
-    ww = width;
-    hh = height;
+// Window contents were damaged (e.g. uncovered)
+void window_refresh_callback(GLFWwindow *window) {
+    request_frames();
 }
 
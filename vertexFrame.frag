@@ -0,0 +1,9 @@
+#version 400 core
+// Tangent frame interpolated from vertex tangent stream (linked with bump fragment shaders)
+in vec3 Tangent;
+in vec3 BiTangent;
+
+mat3 tangent_frame(vec3 N, vec3 P, vec2 uv)
+{
+    return mat3(normalize(Tangent), normalize(BiTangent), N);
+}
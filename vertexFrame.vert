@@ -0,0 +1,15 @@
+#version 400 core
+// Tangent frame from vertex tangent stream (linked with bump vertex shaders)
+layout(location = 3) in vec4 vTangent;
+
+uniform mat4 normal_matrix;
+
+out vec3 Tangent;
+out vec3 BiTangent;
+
+void tangent_frame(vec3 Normal)
+{
+    // Bitangent rebuilt from tangent handedness (w) so mirrored UVs keep correct orientation
+    Tangent = vec3(normalize(normal_matrix*vec4(vTangent.xyz, 0.0)));
+    BiTangent = vTangent.w*cross(Normal, Tangent);
+}